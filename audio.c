@@ -8,7 +8,7 @@ FMOD_CHANNELGROUP *sfx_channel_group;
 FMOD_SOUND *scribble_sound;
 FMOD_SOUND *win_sound;
 
-int audio_init(void) {
+int audio_init(bool silent) {
   // create fmod_system
   FMOD_RESULT fmod_res = FMOD_System_Create(&fmod_system, FMOD_VERSION);
   if (fmod_res != FMOD_OK) {
@@ -16,6 +16,11 @@ int audio_init(void) {
     return 1;
   };
 
+  // sounds are still "played" but nothing is output, so no audio device is needed
+  if (silent) {
+    FMOD_System_SetOutput(fmod_system, FMOD_OUTPUTTYPE_NOSOUND);
+  }
+
   // init FMOD
   FMOD_System_Init(fmod_system, 512, FMOD_INIT_NORMAL, NULL);
 
@@ -1,6 +1,8 @@
 #pragma once
 
-int audio_init(void);
+#include <stdbool.h>
+
+int audio_init(bool silent);
 void audio_close(void);
 void audio_update(void);
 void audio_play_scribble(void);
@@ -1,6 +1,9 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "core.h"
 
@@ -31,3 +34,150 @@ _Noreturn uintptr_t _core_abort(const char* file, int line, const char* message,
   /* fprintf(stderr, "stacktrace:\n%s\n\n", stacktrace); */
   abort();
 }
+
+u64 core_hash_fnv1a_64(const void *data, uptr size, u64 seed) {
+  const u8 *bytes = data;
+  u64 hash = seed;
+
+  for (uptr i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+u32 core_utf8_decode(const char *text, uptr length, uptr *idx) {
+  const u8 *bytes = (const u8 *)text + *idx;
+  uptr remaining = length - *idx;
+  u32 codepoint;
+  uptr count;
+  u32 min;
+
+  if (bytes[0] < 0x80) {
+    *idx += 1;
+    return bytes[0];
+  } else if ((bytes[0] & 0xe0) == 0xc0) {
+    codepoint = bytes[0] & 0x1f;
+    count = 2;
+    min = 0x80;
+  } else if ((bytes[0] & 0xf0) == 0xe0) {
+    codepoint = bytes[0] & 0x0f;
+    count = 3;
+    min = 0x800;
+  } else if ((bytes[0] & 0xf8) == 0xf0) {
+    codepoint = bytes[0] & 0x07;
+    count = 4;
+    min = 0x10000;
+  } else {
+    *idx += 1;
+    return CORE_UTF8_REPLACEMENT_CHAR;
+  }
+
+  if (count > remaining) {
+    *idx += 1;
+    return CORE_UTF8_REPLACEMENT_CHAR;
+  }
+
+  for (uptr i = 1; i < count; i++) {
+    if ((bytes[i] & 0xc0) != 0x80) {
+      *idx += 1;
+      return CORE_UTF8_REPLACEMENT_CHAR;
+    }
+    codepoint = (codepoint << 6) | (bytes[i] & 0x3f);
+  }
+
+  // reject overlong encodings, utf-16 surrogates and anything past U+10FFFF
+  if (codepoint < min || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff) {
+    *idx += 1;
+    return CORE_UTF8_REPLACEMENT_CHAR;
+  }
+
+  *idx += count;
+  return codepoint;
+}
+
+bool core_cache_dir(const char *subdir, char *path_out, uptr path_size) {
+  const char *xdg_cache = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int len;
+  if (xdg_cache && xdg_cache[0]) {
+    len = snprintf(path_out, path_size, "%s/%s", xdg_cache, subdir);
+  } else if (home && home[0]) {
+    len = snprintf(path_out, path_size, "%s/.cache/%s", home, subdir);
+  } else {
+    return false;
+  }
+
+  if (len < 0 || (uptr)len >= path_size) return false;
+
+  // create every directory along the path, like mkdir -p
+  for (char *c = path_out + 1; ; c++) {
+    if (*c != '/' && *c != '\0') continue;
+
+    char sep = *c;
+    *c = '\0';
+    int res = mkdir(path_out, 0755);
+    *c = sep;
+    if (res == -1 && errno != EEXIST) return false;
+
+    if (sep == '\0') break;
+  }
+
+  return true;
+}
+
+void core_arena_init(CoreArena *arena, uptr capacity) {
+  CORE_ZERO_ELMT(arena);
+  arena->data = malloc(capacity);
+  CORE_ASSERT(arena->data, "failed to reserve %zu bytes for arena", capacity);
+  arena->capacity = capacity;
+}
+
+void core_arena_deinit(CoreArena *arena) {
+  free(arena->data);
+  CORE_ZERO_ELMT(arena);
+}
+
+void *core_arena_alloc(CoreArena *arena, uptr size, uptr align) {
+  CORE_DEBUG_ASSERT_POWER_OF_TWO(align);
+
+  uptr offset = CORE_INT_ROUND_UP_ALIGN(arena->size, align);
+  if (CORE_UNLIKELY(offset + size > arena->capacity)) {
+    CORE_ABORT("arena out of memory: requested %zu bytes with %zu of %zu in use", size, arena->size, arena->capacity);
+  }
+
+  arena->last_allocation_offset = offset;
+  arena->size = offset + size;
+  arena->high_water_mark = CORE_MAX(arena->high_water_mark, arena->size);
+  arena->allocations_count++;
+
+  return arena->data + offset;
+}
+
+void *core_arena_realloc(CoreArena *arena, void *ptr, uptr old_size, uptr new_size, uptr align) {
+  if (!ptr) {
+    return core_arena_alloc(arena, new_size, align);
+  }
+
+  uptr offset = (uptr)CORE_PTR_DIFF(ptr, arena->data);
+  if (offset == arena->last_allocation_offset && offset + old_size == arena->size) {
+    if (CORE_UNLIKELY(offset + new_size > arena->capacity)) {
+      CORE_ABORT("arena out of memory: requested %zu bytes with %zu of %zu in use", new_size, arena->size, arena->capacity);
+    }
+    arena->size = offset + new_size;
+    arena->high_water_mark = CORE_MAX(arena->high_water_mark, arena->size);
+    return ptr;
+  }
+
+  void *new_ptr = core_arena_alloc(arena, new_size, align);
+  memcpy(new_ptr, ptr, CORE_MIN(old_size, new_size));
+  return new_ptr;
+}
+
+void core_arena_reset(CoreArena *arena) {
+  arena->most_allocations_count = CORE_MAX(arena->most_allocations_count, arena->allocations_count);
+  arena->size = 0;
+  arena->allocations_count = 0;
+  arena->last_allocation_offset = 0;
+}
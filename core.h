@@ -25,7 +25,7 @@
 #define CORE_UNUSED(expr) ((void)(expr))
 
 // align must be a power of 2
-#define CORE_INT_ROUND_UP_ALIGN(i, align) (((i) + ((align) - )) & ~((align) - 1))
+#define CORE_INT_ROUND_UP_ALIGN(i, align) (((i) + ((align) - 1)) & ~((align) - 1))
 // align must be a power of 2
 #define CORE_INT_ROUND_DOWN_ALIGN(i, align) ((i) & ~((align) - 1))
 
@@ -120,7 +120,96 @@ typedef double f64;
 void _core_assert_failed(const char* cond, const char* file, int line, const char* message, ...);
 _Noreturn uintptr_t _core_abort(const char* file, int line, const char* message, ...);
 
-/* static inline bool core_bitset_is_set(u64* bitset, uptr bit_idx) { */
-/* 	return (bool)(bitset[bit_idx >> 6] & (1 << (bit_idx & 63))); */
-/* } */
+///////////////////////////
+//
+//
+// Arena
+//
+//
+///////////////////////////
+
+// a linear bump allocator over a single block that is reserved once. every
+// allocation lives until the next core_arena_reset() which frees them all at once
+typedef struct CoreArena {
+  u8 *data;
+  uptr size;
+  uptr capacity;
+  // the most bytes that were ever in use between two resets
+  uptr high_water_mark;
+  u32 allocations_count;
+  // the most allocations that were made between two resets
+  u32 most_allocations_count;
+  uptr last_allocation_offset;
+} CoreArena;
+
+void core_arena_init(CoreArena *arena, uptr capacity);
+void core_arena_deinit(CoreArena *arena);
+void *core_arena_alloc(CoreArena *arena, uptr size, uptr align);
+// grows the allocation in place if it is the last one made from the arena,
+// otherwise a new block is allocated and the old contents are copied over
+void *core_arena_realloc(CoreArena *arena, void *ptr, uptr old_size, uptr new_size, uptr align);
+void core_arena_reset(CoreArena *arena);
+
+///////////////////////////
+//
+//
+// Hashing
+//
+//
+///////////////////////////
+
+#define CORE_FNV1A_64_SEED 0xcbf29ce484222325ull
+
+// 64-bit FNV-1a. pass CORE_FNV1A_64_SEED as the seed or the result of a
+// previous call to hash data in multiple chunks
+u64 core_hash_fnv1a_64(const void *data, uptr size, u64 seed);
+
+///////////////////////////
+//
+//
+// UTF-8
+//
+//
+///////////////////////////
+
+#define CORE_UTF8_REPLACEMENT_CHAR 0xfffd
+
+// decodes the codepoint that starts at text[*idx] and advances idx past it.
+// malformed sequences decode to CORE_UTF8_REPLACEMENT_CHAR one byte at a time
+u32 core_utf8_decode(const char *text, uptr length, uptr *idx);
+
+///////////////////////////
+//
+//
+// Filesystem
+//
+//
+///////////////////////////
+
+// writes $XDG_CACHE_HOME/<subdir> (or ~/.cache/<subdir>) into path_out,
+// creating the directories on the way. returns false if there's no cache
+// directory or it can't be created
+bool core_cache_dir(const char *subdir, char *path_out, uptr path_size);
+
+///////////////////////////
+//
+//
+// Bitsets
+//
+//
+///////////////////////////
+
+// a bitset is an array of CORE_DIV_ROUND_UP(bits_count, 64) u64s
+
+static inline bool core_bitset_is_set(const u64 *bitset, uptr bit_idx) {
+  return (bool)((bitset[bit_idx >> 6] >> (bit_idx & 63)) & 1);
+}
+
+static inline void core_bitset_set(u64 *bitset, uptr bit_idx) {
+  bitset[bit_idx >> 6] |= 1ull << (bit_idx & 63);
+}
+
+static inline void core_bitset_unset(u64 *bitset, uptr bit_idx) {
+  bitset[bit_idx >> 6] &= ~(1ull << (bit_idx & 63));
+}
 
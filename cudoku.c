@@ -9,15 +9,26 @@
 #include "audio.h"
 #include "ui.h"
 #include "text.h"
+#include "tween.h"
 #include "zephr.h"
 
-#define HELP_TEXT_SIZE 13
+#define HELP_TEXT_SIZE 14
+// the size of the window the ui was designed for
+#define LAYOUT_DESIGN_SIZE 900.f
+#define SELECTION_MOVE_SECONDS 0.08f
+#define OVERLAY_FADE_SECONDS 0.15f
+#define DIGIT_POP_SECONDS 0.2f
+// how much smaller a digit is when it starts popping in
+#define DIGIT_POP_SHRINK 0.4f
 
 static const Color mistake_color = {255.f, 0.f, 0.f, 127};
 static const Color selection_color = {102, 102, 255, 255};
 
 static const char *win_text = "You won!";
 
+// only the game thread touches it, the tweens point into its game
+TweenPool game_tweens;
+
 static const char *help_texts[HELP_TEXT_SIZE] = {
   "F1 - Toggle help",
   "1-9 - Set number",
@@ -31,6 +42,7 @@ static const char *help_texts[HELP_TEXT_SIZE] = {
   "C - Check for mistakes",
   "R - Reset board",
   "P - Pause/Resume",
+  "F11 - Toggle fullscreen",
   "Ctrl+Q/Esc - Quit"
 };
 
@@ -42,10 +54,35 @@ static const char *help_texts[HELP_TEXT_SIZE] = {
 //
 //////////////////////////////////////
 
+int layout_font_size(const BoardLayout *layout, int font_size) {
+  return CORE_MAX(1, (int)roundf(font_size * layout->scale));
+}
+
+void update_layout(Cudoku *game, Size window_size) {
+  BoardLayout *layout = &game->layout;
+
+  layout->window_size = window_size;
+  // cells are a whole number of pixels so that the lines between them stay crisp.
+  // a window smaller than the board still gets 1px cells so hit testing never
+  // divides by zero
+  layout->cell_size = CORE_MAX(1.f, floorf(CORE_MIN(window_size.width, window_size.height) / 9.f));
+  layout->size = layout->cell_size * 9.f;
+  layout->origin = (Vec2f){
+    .x = floorf((window_size.width - layout->size) / 2.f),
+    .y = floorf((window_size.height - layout->size) / 2.f),
+  };
+  layout->scale = layout->size / LAYOUT_DESIGN_SIZE;
+  layout->thin_line_width = CORE_MAX(1.f, roundf(2.f * layout->scale));
+  layout->thick_line_width = CORE_MAX(2.f, roundf(4.f * layout->scale));
+  layout->digit_font_size = layout_font_size(layout, 72);
+}
+
 void draw_win(Cudoku *game) {
-  Size window = zephr_get_window_size();
-  Color bg_color = {0, 0, 0, 200.f};
-  Color text_color = {237.f, 225.f, 215.f, 255.f};
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_WIN);
+  BoardLayout *layout = &game->layout;
+  float opacity = game->animation.win_opacity;
+  Color bg_color = {0, 0, 0, 200.f * opacity};
+  Color text_color = {237.f, 225.f, 215.f, 255.f * opacity};
 
   char time_text[64];
 
@@ -55,50 +92,51 @@ void draw_win(Cudoku *game) {
   UIConstraints constraints = {0};
   set_x_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
   set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-  set_width_constraint(&constraints, window.width, UI_CONSTRAINT_FIXED);
-  set_height_constraint(&constraints, window.height, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, layout->window_size.width, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, layout->window_size.height, UI_CONSTRAINT_FIXED);
 
   draw_quad(constraints, &bg_color, 0.0, ALIGN_CENTER);
 
   set_width_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
   set_height_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
 
-  set_y_constraint(&constraints, -30, UI_CONSTRAINT_FIXED);
-  draw_text(win_text, 72.f, constraints, &text_color, ALIGN_CENTER);
-  set_y_constraint(&constraints, 30, UI_CONSTRAINT_FIXED);
-  draw_text(time_text, 48.f, constraints, &text_color, ALIGN_CENTER);
+  set_y_constraint(&constraints, -30 * layout->scale, UI_CONSTRAINT_FIXED);
+  draw_text(win_text, layout_font_size(layout, 72), constraints, &text_color, ALIGN_CENTER);
+  set_y_constraint(&constraints, 30 * layout->scale, UI_CONSTRAINT_FIXED);
+  draw_text(time_text, layout_font_size(layout, 48), constraints, &text_color, ALIGN_CENTER);
 }
 
-void draw_board(Cudoku *game, Size window_size) {
+void draw_board(Cudoku *game) {
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_BOARD);
+  BoardLayout *layout = &game->layout;
   Color bg_color = {240.0f, 235.0f, 227.0f, 255.f};
-  Size cell_size = {window_size.width / 9, window_size.height / 9};
   UIConstraints constraints = {0};
   set_x_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
   set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-  set_width_constraint(&constraints, window_size.width, UI_CONSTRAINT_FIXED);
-  set_height_constraint(&constraints, window_size.height, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, layout->window_size.width, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, layout->window_size.height, UI_CONSTRAINT_FIXED);
 
   draw_quad(constraints, &bg_color, 0.0, ALIGN_TOP_LEFT);
 
-  for (int i = 1; i < 9; i++) {
-    set_x_constraint(&constraints, i * 100, UI_CONSTRAINT_FIXED);
-    set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-    if (i % 3 == 0) {
-      set_width_constraint(&constraints, 4, UI_CONSTRAINT_FIXED);
-    } else {
-      set_width_constraint(&constraints, 2, UI_CONSTRAINT_FIXED);
+  // the outer border lines are drawn just outside of the board, so they're
+  // only visible when the window isn't square
+  for (int i = 0; i <= 9; i++) {
+    float line_width = i % 3 == 0 ? layout->thick_line_width : layout->thin_line_width;
+    float offset = i * layout->cell_size;
+    if (i == 0) {
+      offset = -line_width;
     }
-    set_height_constraint(&constraints, window_size.height, UI_CONSTRAINT_FIXED);
+
+    set_x_constraint(&constraints, layout->origin.x + offset, UI_CONSTRAINT_FIXED);
+    set_y_constraint(&constraints, layout->origin.y, UI_CONSTRAINT_FIXED);
+    set_width_constraint(&constraints, line_width, UI_CONSTRAINT_FIXED);
+    set_height_constraint(&constraints, layout->size, UI_CONSTRAINT_FIXED);
     draw_quad(constraints, NULL, 0.0, ALIGN_TOP_LEFT);
 
-    set_x_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-    set_y_constraint(&constraints, i * 100, UI_CONSTRAINT_FIXED);
-    set_width_constraint(&constraints, window_size.width, UI_CONSTRAINT_FIXED);
-    if (i % 3 == 0) {
-      set_height_constraint(&constraints, 4, UI_CONSTRAINT_FIXED);
-    } else {
-      set_height_constraint(&constraints, 2, UI_CONSTRAINT_FIXED);
-    }
+    set_x_constraint(&constraints, layout->origin.x, UI_CONSTRAINT_FIXED);
+    set_y_constraint(&constraints, layout->origin.y + offset, UI_CONSTRAINT_FIXED);
+    set_width_constraint(&constraints, layout->size, UI_CONSTRAINT_FIXED);
+    set_height_constraint(&constraints, line_width, UI_CONSTRAINT_FIXED);
     draw_quad(constraints, NULL, 0.0, ALIGN_TOP_LEFT);
   }
 
@@ -118,13 +156,19 @@ void draw_board(Cudoku *game, Size window_size) {
         }
         char num[2];
         snprintf(num, sizeof(num), "%d", game->board[i][j].value);
-        Sizef text_size = calculate_text_size(num, 72.f);
-        set_y_constraint(&constraints, i * 100 + cell_size.height / 2.f - text_size.height / 2.f, UI_CONSTRAINT_FIXED);
-        set_x_constraint(&constraints, j * 100 + cell_size.width / 2.f - text_size.width / 2.f, UI_CONSTRAINT_FIXED);
+        // the digit is scaled around the centre of its cell
+        float scale = 1.f + game->animation.digit_pop[i][j];
+        Sizef text_size = calculate_text_size(num, layout->digit_font_size);
+        text_size.width *= scale;
+        text_size.height *= scale;
+        set_width_constraint(&constraints, scale, UI_CONSTRAINT_FIXED);
+        set_height_constraint(&constraints, scale, UI_CONSTRAINT_FIXED);
+        set_y_constraint(&constraints, layout->origin.y + i * layout->cell_size + layout->cell_size / 2.f - text_size.height / 2.f, UI_CONSTRAINT_FIXED);
+        set_x_constraint(&constraints, layout->origin.x + j * layout->cell_size + layout->cell_size / 2.f - text_size.width / 2.f, UI_CONSTRAINT_FIXED);
         if (game->board[i][j].is_locked) {
-          add_text_instance(&batch, num, 72.f, constraints, NULL, ALIGN_TOP_LEFT);
+          add_text_instance(&batch, num, layout->digit_font_size, constraints, NULL, ALIGN_TOP_LEFT);
         } else {
-          add_text_instance(&batch, num, 72.f, constraints, &selection_color, ALIGN_TOP_LEFT);
+          add_text_instance(&batch, num, layout->digit_font_size, constraints, &selection_color, ALIGN_TOP_LEFT);
         }
       }
     }
@@ -133,85 +177,98 @@ void draw_board(Cudoku *game, Size window_size) {
   }
 }
 
-void draw_selection_box(int x, int y, const Color color) {
+void draw_selection_box(Cudoku *game, float x, float y, const Color color) {
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_HIGHLIGHT);
+  BoardLayout *layout = &game->layout;
   UIConstraints constraints = {0};
-  set_x_constraint(&constraints, x * 100, UI_CONSTRAINT_FIXED);
-  set_y_constraint(&constraints, y * 100, UI_CONSTRAINT_FIXED);
-  set_width_constraint(&constraints, 100, UI_CONSTRAINT_FIXED);
-  set_height_constraint(&constraints, 100, UI_CONSTRAINT_FIXED);
+  set_x_constraint(&constraints, layout->origin.x + x * layout->cell_size, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&constraints, layout->origin.y + y * layout->cell_size, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, layout->cell_size, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, layout->cell_size, UI_CONSTRAINT_FIXED);
 
   draw_quad(constraints, &color, 0.0, ALIGN_TOP_LEFT);
 }
 
-void draw_pause_overlay(void) {
-  Size window = zephr_get_window_size();
-  Color bg_color = {0, 0, 0, 200.f};
-  Color text_color = {237.f, 225.f, 215.f, 255.f};
+void draw_pause_overlay(Cudoku *game) {
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_PAUSE);
+  BoardLayout *layout = &game->layout;
+  float opacity = game->animation.pause_opacity;
+  Color bg_color = {0, 0, 0, 200.f * opacity};
+  Color text_color = {237.f, 225.f, 215.f, 255.f * opacity};
 
   UIConstraints constraints = {0};
   set_x_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
   set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-  set_width_constraint(&constraints, window.width, UI_CONSTRAINT_FIXED);
-  set_height_constraint(&constraints, window.height, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, layout->window_size.width, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, layout->window_size.height, UI_CONSTRAINT_FIXED);
 
   draw_quad(constraints, &bg_color, 0.0, ALIGN_CENTER);
 
   set_width_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
   set_height_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
 
-  draw_text("Paused", 100.f, constraints, &text_color, ALIGN_CENTER);
+  draw_text("Paused", layout_font_size(layout, 100), constraints, &text_color, ALIGN_CENTER);
 }
 
 void draw_mistakes_highlight(Cudoku *game) {
+  float opacity = game->animation.mistakes_opacity;
+  Color color = mistake_color;
+  color.a *= opacity;
+
   for (int i = 0; i < 9; i++) {
     for (int j = 0; j < 9; j++) {
       Cell cell = game->board[i][j];
       if (cell.value != 0 && cell.value != game->solution[i][j]) {
-        draw_selection_box(j, i, mistake_color);
+        draw_selection_box(game, j, i, color);
       }
     }
   }
 
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_HUD);
   UIConstraints constraints = {0};
 
-  const int font_size = 24;
+  const int font_size = layout_font_size(&game->layout, 24);
   const char *text = "Mistake highlighter is ON";
   Sizef text_size = calculate_text_size(text, font_size);
   set_width_constraint(&constraints, text_size.width, UI_CONSTRAINT_FIXED);
   set_height_constraint(&constraints, text_size.height, UI_CONSTRAINT_FIXED);
-  draw_quad(constraints, &(Color){0, 0, 0, 30}, 0.0, ALIGN_BOTTOM_LEFT);
+  draw_quad(constraints, &(Color){0, 0, 0, 30 * opacity}, 0.0, ALIGN_BOTTOM_LEFT);
 
   set_width_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
   set_height_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
-  draw_text(text, font_size, constraints, &(Color){255, 0, 0, 255}, ALIGN_BOTTOM_LEFT);
+  draw_text(text, font_size, constraints, &(Color){255, 0, 0, 255 * opacity}, ALIGN_BOTTOM_LEFT);
 }
 
-void draw_help(Timer *timer) {
-  int const text_padding = 10;
-  int const help_font_size = 24;
-  int const closing_in_font_size = 18;
+void draw_help(Cudoku *game) {
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_HELP);
+  BoardLayout *layout = &game->layout;
+  Timer *timer = &game->help_timer;
+  float const opacity = game->animation.help_opacity;
+  float const text_padding = 10 * layout->scale;
+  int const help_font_size = layout_font_size(layout, 24);
+  int const closing_in_font_size = layout_font_size(layout, 18);
   Color const bg_color = {
     .r = 0.f,
     .g = 0.f,
     .b = 0.f,
-    .a = 185.f
+    .a = 185.f * opacity
   };
   Color const text_color = {
     237.f,
     255.f,
     255.f,
-    255.f,
+    255.f * opacity,
   };
   Color const closing_in_text_color = {
     .r = 255.0f,
     .g = 150.0f,
     .b = 0.0f,
-    .a = 255.0f,
+    .a = 255.0f * opacity,
   };
 
   float overlay_height = 0;
   float overlay_width = 0;
-  float total_help_texts_height = 10;
+  float total_help_texts_height = text_padding;
 
   for (int i = 0; i < HELP_TEXT_SIZE; i++) {
     Sizef text_size = calculate_text_size(help_texts[i], help_font_size);
@@ -250,10 +307,13 @@ void draw_help(Timer *timer) {
   draw_text_batch(&batch);
 }
 
-void draw_timer(Timer *timer) {
+void draw_timer(Cudoku *game) {
+  Timer *timer = &game->timer;
   if (timer->state == TIMER_STOPPED) return;
 
-  const int font_size = 32;
+  renderer_set_layer(&zephr_ctx.renderer, LAYER_HUD);
+  const int font_size = layout_font_size(&game->layout, 32);
+  const float padding = 4 * game->layout.scale;
   const Color text_color = {
     .r = 66.0f,
     .g = 92.0f,
@@ -287,8 +347,8 @@ void draw_timer(Timer *timer) {
   UIConstraints constraints = {0};
   set_x_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
   set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
-  set_width_constraint(&constraints, text_size.width + 4, UI_CONSTRAINT_FIXED);
-  set_height_constraint(&constraints, text_size.height + 4, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, text_size.width + padding, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, text_size.height + padding, UI_CONSTRAINT_FIXED);
 
   draw_quad(constraints, &bg_color, 0.0, alignment);
 
@@ -328,8 +388,8 @@ void toggle_check(Cudoku *game) {
 void do_selection(Cudoku *game, int x, int y) {
   if (game->has_won || game->timer.state == TIMER_PAUSED) return;
 
-  int cell_x = (int)floor(x / 100.f);
-  int cell_y = (int)floor(y / 100.f);
+  int cell_x = (int)floor((x - game->layout.origin.x) / game->layout.cell_size);
+  int cell_y = (int)floor((y - game->layout.origin.y) / game->layout.cell_size);
 
   if (cell_x < 0 || cell_x > 8 || cell_y < 0 || cell_y > 8) {
     game->should_draw_selection = false;
@@ -374,8 +434,12 @@ bool check_win(Cudoku *game) {
 
 void set_selected_number(Cudoku *game, int number) {
   if (game->should_draw_selection && !game->has_won && !game->board[game->selection.x][game->selection.y].is_locked) {
-    if (number != 0)
+    if (number != 0) {
       audio_play_scribble();
+      float *pop = &game->animation.digit_pop[game->selection.x][game->selection.y];
+      *pop = -DIGIT_POP_SHRINK;
+      tween_start(&game_tweens, pop, 0.f, DIGIT_POP_SECONDS, EASE_OUT_BACK);
+    }
     game->board[game->selection.x][game->selection.y].value = number;
     check_win(game);
   }
@@ -650,3 +714,55 @@ bool toggle_help(Cudoku *game) {
   return game->should_draw_help;
 }
 
+bool update_game(Cudoku *game, float dt) {
+  if (timer_ended(&game->help_timer)) {
+    timer_stop(&game->help_timer);
+    game->should_draw_help = false;
+  }
+
+  // the animations follow the state, whatever changed it
+  CudokuAnimation *animation = &game->animation;
+  Vec2f selection = { (float)game->selection.y, (float)game->selection.x };
+  if (game->should_draw_selection) {
+    tween_to(&game_tweens, &animation->selection.x, selection.x, SELECTION_MOVE_SECONDS, EASE_OUT_CUBIC);
+    tween_to(&game_tweens, &animation->selection.y, selection.y, SELECTION_MOVE_SECONDS, EASE_OUT_CUBIC);
+  } else {
+    // a hidden selection shows up where it is without sliding there
+    tween_cancel(&game_tweens, &animation->selection.x);
+    tween_cancel(&game_tweens, &animation->selection.y);
+    animation->selection = selection;
+  }
+
+  tween_to(&game_tweens, &animation->help_opacity, game->should_draw_help, OVERLAY_FADE_SECONDS, EASE_OUT_QUAD);
+  tween_to(&game_tweens, &animation->pause_opacity, game->timer.state == TIMER_PAUSED, OVERLAY_FADE_SECONDS, EASE_OUT_QUAD);
+  tween_to(&game_tweens, &animation->win_opacity, game->has_won, OVERLAY_FADE_SECONDS, EASE_OUT_QUAD);
+  tween_to(&game_tweens, &animation->mistakes_opacity, game->should_highlight_mistakes, OVERLAY_FADE_SECONDS, EASE_OUT_QUAD);
+
+  return tween_pool_update(&game_tweens, dt);
+}
+
+u64 shown_time_key(Cudoku *game) {
+  u64 elapsed = 0;
+  if (game->timer.state == TIMER_RUNNING) {
+    elapsed = (u64)timer_elapsed(&game->timer);
+  } else if (game->timer.state == TIMER_PAUSED) {
+    elapsed = (u64)game->timer.elapsed;
+  }
+
+  u64 remaining = 0;
+  if (game->help_timer.state == TIMER_RUNNING) {
+    remaining = (u64)timer_remaining(&game->help_timer) + 1;
+  }
+
+  return elapsed << 32 | remaining;
+}
+
+double time_until_shown_change(Cudoku *game) {
+  double game_timer = timer_next_second(&game->timer);
+  // the help counts down whole seconds from a whole number of seconds, so it
+  // changes and ends on the whole seconds of its elapsed time
+  double help_timer = timer_next_second(&game->help_timer);
+  if (game_timer < 0.0) return help_timer;
+  if (help_timer < 0.0) return game_timer;
+  return CORE_MIN(game_timer, help_timer);
+}
@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 
+#include "core.h"
 #include "timer.h"
 #include "zephr_math.h"
 
@@ -10,6 +11,46 @@ typedef struct Cell {
   bool is_locked;
 } Cell;
 
+// where the board goes and how big everything is drawn for the current
+// window size. it's only recomputed when the window is resized and is shared
+// by drawing and hit testing
+typedef struct BoardLayout {
+  Size window_size;
+  // the board is square and centred in the window
+  Vec2f origin;
+  float size;
+  float cell_size;
+  float thin_line_width;
+  float thick_line_width;
+  // the ui is designed for a 900x900 window and scaled from there
+  float scale;
+  int digit_font_size;
+} BoardLayout;
+
+// the render layers of the game, drawn bottom to top whatever order the draws
+// are made in
+typedef enum CudokuLayer {
+  LAYER_BOARD,
+  LAYER_HIGHLIGHT,
+  LAYER_HUD,
+  LAYER_HELP,
+  LAYER_WIN,
+  LAYER_PAUSE,
+} CudokuLayer;
+
+// what's drawn in between states, animated by tweens on the game thread and
+// copied into the snapshots with the rest of the game
+typedef struct CudokuAnimation {
+  // the cell the selection box is drawn at, x is the column and y the row
+  Vec2f selection;
+  float help_opacity;
+  float pause_opacity;
+  float win_opacity;
+  float mistakes_opacity;
+  // added to the scale of a digit, it pops in when it's placed
+  float digit_pop[9][9];
+} CudokuAnimation;
+
 typedef struct Cudoku {
   Cell board[9][9];
   int solution[9][9];
@@ -21,15 +62,18 @@ typedef struct Cudoku {
   Timer help_timer;
   Timer timer;
   double win_time;
+  BoardLayout layout;
+  CudokuAnimation animation;
 } Cudoku;
 
-void draw_selection_box(int x, int y, const Color color);
+void update_layout(Cudoku *game, Size window_size);
+void draw_selection_box(Cudoku *game, float x, float y, const Color color);
 void draw_mistakes_highlight(Cudoku *game);
-void draw_pause_overlay(void);
-void draw_help(Timer *timer);
-void draw_timer(Timer *timer);
+void draw_pause_overlay(Cudoku *game);
+void draw_help(Cudoku *game);
+void draw_timer(Cudoku *game);
 void draw_win(Cudoku *game);
-void draw_board(Cudoku *game, Size window_size);
+void draw_board(Cudoku *game);
 
 void toggle_check(Cudoku *game);
 void do_selection(Cudoku *game, int x, int y);
@@ -39,4 +83,13 @@ void toggle_selection(Cudoku *game);
 void generate_random_board(Cudoku *game);
 void reset_board(Cudoku *game);
 bool toggle_help(Cudoku *game);
+// advances the state that changes with time alone, like the help hiding and
+// the animations, by a fixed step of dt seconds. returns whether anything
+// was animated, i.e. whether the frame needs drawing again
+bool update_game(Cudoku *game, float dt);
+// changes whenever one of the times shown on screen does
+u64 shown_time_key(Cudoku *game);
+// the time until shown_time_key() changes or the help hides by itself,
+// negative when nothing changes with time alone
+double time_until_shown_change(Cudoku *game);
 void pause_game(Cudoku *game);
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "gl_stats.h"
+
+GLStats gl_stats;
+GLStats gl_stats_last_frame;
+
+void gl_stats_end_frame(void) {
+  gl_stats_last_frame = gl_stats;
+  CORE_ZERO_ELMT(&gl_stats);
+}
+
+int gl_pixel_size(GLenum format) {
+  switch (format) {
+    case GL_RED: return 1;
+    case GL_RG: return 2;
+    case GL_RGB: return 3;
+    default: return 4;
+  }
+}
+
+u64 gl_upload_size(const void *data, u64 size) {
+  return data ? size : 0;
+}
+
+const char *gl_error_name(GLenum error) {
+  switch (error) {
+    case GL_INVALID_ENUM: return "GL_INVALID_ENUM";
+    case GL_INVALID_VALUE: return "GL_INVALID_VALUE";
+    case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
+    case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
+    case GL_OUT_OF_MEMORY: return "GL_OUT_OF_MEMORY";
+    default: return "unknown";
+  }
+}
+
+void gl_check_error(const char *call, const char *file, int line) {
+  GLenum error;
+  while ((error = glGetError()) != GL_NO_ERROR) {
+    gl_stats.errors_count++;
+    printf("[ERROR] %s (0x%x) from %s at %s:%d\n", gl_error_name(error), error, call, file, line);
+  }
+}
+
+#if ZEPHR_GL_CHECK
+void GLAD_API_PTR gl_debug_message(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *user_data) {
+  CORE_UNUSED(source);
+  CORE_UNUSED(id);
+  CORE_UNUSED(length);
+  CORE_UNUSED(user_data);
+  if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) return;
+
+  if (type == GL_DEBUG_TYPE_ERROR) {
+    gl_stats.errors_count++;
+    printf("[ERROR] GL: %s\n", message);
+  } else {
+    printf("[WARN] GL: %s\n", message);
+  }
+}
+#endif
+
+void gl_enable_debug_output(void) {
+#if ZEPHR_GL_CHECK
+  if (!GLAD_GL_KHR_debug) {
+    printf("[WARN] KHR_debug isn't supported, only glGetError is checked\n");
+    return;
+  }
+
+  // synchronous so that the messages come from within the call that caused them
+  glEnable(GL_DEBUG_OUTPUT);
+  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDebugMessageCallback(gl_debug_message, NULL);
+#endif
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include "core.h"
+
+// counts the gl calls made while drawing, so that regressions in batching
+// show up as numbers. the gl entry points are macros in glad, this header
+// shadows the ones the renderer uses with wrappers that count them, so it
+// has to be included after glad.
+//
+// ZEPHR_GL_STATS=0 (release builds) leaves the entry points alone and drops
+// the counters. ZEPHR_GL_CHECK=1 also checks glGetError after every wrapped
+// call and reports KHR_debug messages
+#ifndef ZEPHR_GL_STATS
+#define ZEPHR_GL_STATS 0
+#endif
+#ifndef ZEPHR_GL_CHECK
+#define ZEPHR_GL_CHECK 0
+#endif
+
+typedef struct GLStats {
+  int draw_calls_count;
+  // binds, enables, attribute pointers and the like
+  int state_changes_count;
+  int uniform_updates_count;
+  int program_switches_count;
+  // to buffers and textures, including the writes to mapped buffers
+  u64 uploaded_bytes;
+  int errors_count;
+} GLStats;
+
+#if ZEPHR_GL_STATS || ZEPHR_GL_CHECK
+// the counters of the frame being drawn and of the last one that was
+// swapped. only touched by the thread that owns the context
+extern GLStats gl_stats;
+extern GLStats gl_stats_last_frame;
+
+void gl_stats_end_frame(void);
+// the size in bytes of a pixel of the format, for counting texture uploads
+int gl_pixel_size(GLenum format);
+// the size of an upload, which is 0 when there's no data to upload
+u64 gl_upload_size(const void *data, u64 size);
+void gl_check_error(const char *call, const char *file, int line);
+// routes the KHR_debug messages to stdout when ZEPHR_GL_CHECK is set. MUST be
+// called after gl is loaded
+void gl_enable_debug_output(void);
+#else
+// gl_stats.c isn't built at all then
+#define gl_stats_end_frame() ((void)0)
+#define gl_enable_debug_output() ((void)0)
+#endif
+
+#if ZEPHR_GL_STATS
+#define GL_STATS_COUNT(counter, n) (gl_stats.counter += (n))
+#else
+#define GL_STATS_COUNT(counter, n) ((void)0)
+#endif
+
+#if ZEPHR_GL_CHECK
+#define GL_CHECK(call) (call, gl_check_error(#call, __FILE__, __LINE__))
+#else
+#define GL_CHECK(call) (call)
+#endif
+
+#if ZEPHR_GL_STATS || ZEPHR_GL_CHECK
+
+#define GL_WRAP(counter, call) (GL_STATS_COUNT(counter, 1), GL_CHECK(call))
+
+#undef glDrawArraysInstanced
+#define glDrawArraysInstanced(...) GL_WRAP(draw_calls_count, glad_glDrawArraysInstanced(__VA_ARGS__))
+#undef glDrawElementsInstanced
+#define glDrawElementsInstanced(...) GL_WRAP(draw_calls_count, glad_glDrawElementsInstanced(__VA_ARGS__))
+
+// a clear isn't a draw call, it's only checked
+#undef glClear
+#define glClear(...) GL_CHECK(glad_glClear(__VA_ARGS__))
+
+#undef glBindBuffer
+#define glBindBuffer(...) GL_WRAP(state_changes_count, glad_glBindBuffer(__VA_ARGS__))
+#undef glBindTexture
+#define glBindTexture(...) GL_WRAP(state_changes_count, glad_glBindTexture(__VA_ARGS__))
+#undef glBindVertexArray
+#define glBindVertexArray(...) GL_WRAP(state_changes_count, glad_glBindVertexArray(__VA_ARGS__))
+#undef glActiveTexture
+#define glActiveTexture(...) GL_WRAP(state_changes_count, glad_glActiveTexture(__VA_ARGS__))
+#undef glEnable
+#define glEnable(...) GL_WRAP(state_changes_count, glad_glEnable(__VA_ARGS__))
+#undef glDisable
+#define glDisable(...) GL_WRAP(state_changes_count, glad_glDisable(__VA_ARGS__))
+#undef glScissor
+#define glScissor(...) GL_WRAP(state_changes_count, glad_glScissor(__VA_ARGS__))
+#undef glPixelStorei
+#define glPixelStorei(...) GL_WRAP(state_changes_count, glad_glPixelStorei(__VA_ARGS__))
+#undef glTexParameteri
+#define glTexParameteri(...) GL_WRAP(state_changes_count, glad_glTexParameteri(__VA_ARGS__))
+#undef glVertexAttribPointer
+#define glVertexAttribPointer(...) GL_WRAP(state_changes_count, glad_glVertexAttribPointer(__VA_ARGS__))
+#undef glVertexAttribIPointer
+#define glVertexAttribIPointer(...) GL_WRAP(state_changes_count, glad_glVertexAttribIPointer(__VA_ARGS__))
+#undef glEnableVertexAttribArray
+#define glEnableVertexAttribArray(...) GL_WRAP(state_changes_count, glad_glEnableVertexAttribArray(__VA_ARGS__))
+#undef glVertexAttribDivisor
+#define glVertexAttribDivisor(...) GL_WRAP(state_changes_count, glad_glVertexAttribDivisor(__VA_ARGS__))
+#undef glTexBuffer
+#define glTexBuffer(...) GL_WRAP(state_changes_count, glad_glTexBuffer(__VA_ARGS__))
+
+#undef glUniform1i
+#define glUniform1i(...) GL_WRAP(uniform_updates_count, glad_glUniform1i(__VA_ARGS__))
+#undef glUniform1f
+#define glUniform1f(...) GL_WRAP(uniform_updates_count, glad_glUniform1f(__VA_ARGS__))
+#undef glUniform2f
+#define glUniform2f(...) GL_WRAP(uniform_updates_count, glad_glUniform2f(__VA_ARGS__))
+#undef glUniform3f
+#define glUniform3f(...) GL_WRAP(uniform_updates_count, glad_glUniform3f(__VA_ARGS__))
+#undef glUniform4f
+#define glUniform4f(...) GL_WRAP(uniform_updates_count, glad_glUniform4f(__VA_ARGS__))
+#undef glUniformMatrix4fv
+#define glUniformMatrix4fv(...) GL_WRAP(uniform_updates_count, glad_glUniformMatrix4fv(__VA_ARGS__))
+
+#undef glUseProgram
+#define glUseProgram(...) GL_WRAP(program_switches_count, glad_glUseProgram(__VA_ARGS__))
+
+// the uploads count their size instead, some arguments are evaluated twice
+#undef glBufferData
+#define glBufferData(target, size, data, usage) \
+  (GL_STATS_COUNT(uploaded_bytes, gl_upload_size(data, (u64)(size))), GL_CHECK(glad_glBufferData(target, size, data, usage)))
+#undef glBufferSubData
+#define glBufferSubData(target, offset, size, data) \
+  (GL_STATS_COUNT(uploaded_bytes, (u64)(size)), GL_CHECK(glad_glBufferSubData(target, offset, size, data)))
+#undef glTexImage2D
+#define glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels) \
+  (GL_STATS_COUNT(uploaded_bytes, gl_upload_size(pixels, (u64)(width) * (height) * gl_pixel_size(format))), \
+   GL_CHECK(glad_glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels)))
+#undef glTexSubImage2D
+#define glTexSubImage2D(target, level, x, y, width, height, format, type, pixels) \
+  (GL_STATS_COUNT(uploaded_bytes, (u64)(width) * (height) * gl_pixel_size(format)), \
+   GL_CHECK(glad_glTexSubImage2D(target, level, x, y, width, height, format, type, pixels)))
+
+#endif
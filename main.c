@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,22 +10,174 @@
 
 #include "audio.h"
 #include "cudoku.h"
+#include "gl_stats.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "startup.h"
 #include "timer.h"
 #include "zephr.h"
 #include "zephr_math.h"
 
 #define DEBUG 1
 
+// the game thread handles input and the game logic while the render thread
+// draws, they only share the snapshots the game thread publishes when
+// something changed
+// the game logic and animations advance in fixed steps whatever the frame
+// rate, so they play the same at any present mode
+#define GAME_UPDATE_HZ 120.0
+// after a stall the game skips ahead instead of running every step it missed
+#define GAME_MAX_CATCH_UP_S 0.25
+// a held direction key moves the selection once, then again every interval
+// after the delay
+#define MOVE_REPEAT_DELAY_S 0.3
+#define MOVE_REPEAT_INTERVAL_S 0.06
+
 const char *font_path = "assets/fonts/Rubik/Rubik-VariableFont_wght.ttf";
 const char *title = "Cudoku";
+FontRenderMode font_render_mode = FONT_RENDER_MODE_BITMAP;
+// the number of frames to render headless, negative opens a window instead
+int headless_frames = -1;
+const char *dump_dir = NULL;
+const char *dump_format = "png";
+ZephrAntiAliasing anti_aliasing = ZEPHR_ANTI_ALIASING_ANALYTIC;
+// set by the render thread when a frame couldn't be saved
+bool dump_failed = false;
+
+typedef enum FramePhase {
+  FRAME_PHASE_SNAPSHOT,
+  FRAME_PHASE_BOARD,
+  FRAME_PHASE_OVERLAYS,
+  FRAME_PHASE_PROFILER,
+  FRAME_PHASE_FLUSH,
+  FRAME_PHASE_SWAP,
+  FRAME_PHASES_COUNT,
+} FramePhase;
+
+const char *frame_phase_names[FRAME_PHASES_COUNT] = {
+  "snapshot",
+  "board",
+  "overlays",
+  "profiler",
+  "flush",
+  "swap",
+};
+
+// owned by the render thread
+Profiler profiler;
+
+typedef struct RenderSettings {
+  bool show_profiler;
+  ZephrPresentMode present_mode;
+  double frame_cap_hz;
+  bool render_late;
+} RenderSettings;
+
+// everything the render thread needs to draw a frame, copied out of the game
+// state by the game thread
+typedef struct FrameSnapshot {
+  Cudoku game;
+  RenderSettings settings;
+  // get_time() when the snapshot was taken, the timers are drawn at that time
+  double time;
+  // when the earliest input the snapshot reflects was received, -1 if none
+  double input_ms;
+  // the number of the headless frame
+  int frame;
+  // the render thread exits instead of drawing this one
+  bool quit;
+} FrameSnapshot;
+
+// the settings as requested on the command line and with the function keys,
+// owned by the game thread
+RenderSettings settings = {
+  .present_mode = ZEPHR_PRESENT_MODE_VSYNC,
+};
+const char *latency_out = NULL;
+const char *startup_trace_out = NULL;
+#if ZEPHR_GL_STATS
+// every drawn frame's gl stats are written to it as csv, owned by the render thread
+FILE *gl_stats_out = NULL;
+#endif
+
+SnapshotBuffer snapshots;
+// signalled on every publish for the render thread to wait on when idle
+pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t snapshot_published = PTHREAD_COND_INITIALIZER;
+// the earliest input that no snapshot the render thread took reflects yet, and
+// the sequence of the first snapshot that did
+double pending_input_ms = -1.0;
+u64 pending_input_sequence = 0;
+
+// the time not yet simulated by the fixed updates
+double update_accumulator = 0.0;
+double last_update_time = -1.0;
+
+// the keys that move the selection in a direction
+typedef struct MoveKeys {
+  ZephrKeycode keys[3];
+  int x;
+  int y;
+} MoveKeys;
+
+const MoveKeys move_keys[] = {
+  { { ZEPHR_KEYCODE_LEFT, ZEPHR_KEYCODE_A, ZEPHR_KEYCODE_H }, -1, 0 },
+  { { ZEPHR_KEYCODE_RIGHT, ZEPHR_KEYCODE_D, ZEPHR_KEYCODE_L }, 1, 0 },
+  { { ZEPHR_KEYCODE_UP, ZEPHR_KEYCODE_W, ZEPHR_KEYCODE_K }, 0, -1 },
+  { { ZEPHR_KEYCODE_DOWN, ZEPHR_KEYCODE_S, ZEPHR_KEYCODE_J }, 0, 1 },
+};
+// when the held direction keys next move the selection, negative if none are held
+double next_move_time = -1.0;
+
+// the first board is generated on a worker while zephr starts up
+Cudoku first_game;
+unsigned int first_game_seed;
 
 void usage() {
   printf("Usage: cudoku [OPTION]\n\n");
   printf("  %-30s%-20s", "-h, --help", "prints this help message\n");
   printf("  %-30s%-20s", "-f, --font <path_to_font>", "use a custom font file to render text\n");
+  printf("  %-30s%-20s", "--size <width>x<height>", "initial size of the window, 900x900 by default\n");
+  printf("  %-30s%-20s", "--sdf", "render text from a signed distance field atlas\n");
+  printf("  %-30s%-20s", "--profile", "show the frame profiler overlay, toggled with F3\n");
+  printf("  %-30s%-20s", "--present-mode <mode>", "vsync, adaptive, uncapped or capped, cycled with F4\n");
+  printf("  %-30s%-20s", "--frame-cap <hz>", "cap the frame rate by sleeping, implies --present-mode capped\n");
+  printf("  %-30s%-20s", "--aa <mode>", "none, analytic, msaa2, msaa4 or msaa8 (analytic by default)\n");
+  printf("  %-30s%-20s", "--render-late", "read input just before the frame is due, toggled with F5\n");
+  printf("  %-30s%-20s", "--latency-out <path>", "export the input latency histograms as csv on exit\n");
+#if ZEPHR_GL_STATS
+  printf("  %-30s%-20s", "--gl-stats-out <path>", "write the gl call counts of every frame as csv\n");
+#endif
+  printf("  %-30s%-20s", "--startup-trace <path>", "write the timeline of the startup as a chrome trace\n");
+  printf("  %-30s%-20s", "--headless <frames>", "render a scripted game offscreen and print frame checksums\n");
+  printf("  %-30s%-20s", "--dump <dir>", "with --headless, also save every frame into the directory\n");
+  printf("  %-30s%-20s", "--dump-format <png|ppm>", "image format of the dumped frames (png by default)\n");
 }
 
+// applies the frame pacing settings and starts measuring them from scratch
+void apply_frame_pacing(const RenderSettings *requested) {
+  ZephrPresentMode present_mode = zephr_set_present_mode(requested->present_mode, requested->frame_cap_hz);
+  double frame_cap_hz = zephr_ctx.pacing.frame_cap_hz;
+  zephr_set_render_late(requested->render_late);
+
+  profiler.budget_ms = (float)zephr_frame_budget_ms();
+  if (present_mode == ZEPHR_PRESENT_MODE_CAPPED) {
+    snprintf(profiler.title, sizeof(profiler.title), "present %s at %.0fhz%s",
+        zephr_present_mode_name(present_mode), frame_cap_hz, requested->render_late ? ", render late" : "");
+  } else {
+    snprintf(profiler.title, sizeof(profiler.title), "present %s%s",
+        zephr_present_mode_name(present_mode), requested->render_late ? ", render late" : "");
+  }
+  profiler_reset(&profiler);
+
+  printf("[INFO] Frame pacing: %s\n", profiler.title);
+}
+
+// the selection is moved by update_held_moves() instead, which also repeats
+// the moves while the keys are held
 void handle_keypress(ZephrEvent e, Cudoku *game) {
+  if (e.key.is_repeat) return;
+
   if (e.key.code == ZEPHR_KEYCODE_R) {
     reset_board(game);
   } else if (
@@ -53,26 +207,6 @@ void handle_keypress(ZephrEvent e, Cudoku *game) {
   } else if (e.key.code == ZEPHR_KEYCODE_BACKSPACE ||
       e.key.code == ZEPHR_KEYCODE_DELETE) {
     set_selected_number(game, 0);
-  } else if (
-      e.key.code == ZEPHR_KEYCODE_LEFT ||
-      e.key.code == ZEPHR_KEYCODE_A ||
-      e.key.code == ZEPHR_KEYCODE_H) {
-    move_selection(game, -1, 0);
-  } else if (
-      e.key.code == ZEPHR_KEYCODE_RIGHT ||
-      e.key.code == ZEPHR_KEYCODE_D ||
-      e.key.code == ZEPHR_KEYCODE_L) {
-    move_selection(game, 1, 0);
-  } else if (
-      e.key.code == ZEPHR_KEYCODE_UP ||
-      e.key.code == ZEPHR_KEYCODE_W ||
-      e.key.code == ZEPHR_KEYCODE_K) {
-    move_selection(game, 0, -1);
-  } else if (
-      e.key.code == ZEPHR_KEYCODE_DOWN ||
-      e.key.code == ZEPHR_KEYCODE_S ||
-      e.key.code == ZEPHR_KEYCODE_J) {
-    move_selection(game, 0, 1);
   } else if (
       e.key.code == ZEPHR_KEYCODE_ENTER ||
       e.key.code == ZEPHR_KEYCODE_SPACE) {
@@ -87,10 +221,418 @@ void handle_keypress(ZephrEvent e, Cudoku *game) {
     if (!toggle_help(game)) {
       timer_stop(&game->help_timer);
     }
+  } else if (e.key.code == ZEPHR_KEYCODE_F11) {
+    zephr_toggle_fullscreen();
+  } else if (e.key.code == ZEPHR_KEYCODE_F3) {
+    settings.show_profiler = !settings.show_profiler;
+  } else if (e.key.code == ZEPHR_KEYCODE_F4) {
+    settings.present_mode = (settings.present_mode + 1) % ZEPHR_PRESENT_MODES_COUNT;
+    if (settings.present_mode == ZEPHR_PRESENT_MODE_CAPPED && settings.frame_cap_hz <= 0.0) {
+      settings.frame_cap_hz = zephr_ctx.pacing.refresh_hz;
+    }
+  } else if (e.key.code == ZEPHR_KEYCODE_F5) {
+    settings.render_late = !settings.render_late;
+  }
+}
+
+void draw_frame(Cudoku *game) {
+  profiler_begin(&profiler, FRAME_PHASE_BOARD);
+  draw_board(game);
+  profiler_end(&profiler, FRAME_PHASE_BOARD);
+
+  profiler_begin(&profiler, FRAME_PHASE_OVERLAYS);
+  draw_timer(game);
+
+  if (game->should_draw_selection) {
+    draw_selection_box(game, game->animation.selection.x, game->animation.selection.y, (Color){102, 102, 255, 127});
+  }
+
+  // the overlays are drawn for as long as they're fading out
+  if (game->animation.mistakes_opacity > 0.f) {
+    draw_mistakes_highlight(game);
+  }
+
+  if (game->animation.help_opacity > 0.f) {
+    draw_help(game);
+  }
+
+  if (game->animation.win_opacity > 0.f) {
+    draw_win(game);
+  }
+
+  if (game->animation.pause_opacity > 0.f) {
+    draw_pause_overlay(game);
+  }
+  profiler_end(&profiler, FRAME_PHASE_OVERLAYS);
+
+  if (profiler.show_overlay) {
+    profiler_begin(&profiler, FRAME_PHASE_PROFILER);
+    profiler_draw_overlay(&profiler);
+    profiler_end(&profiler, FRAME_PHASE_PROFILER);
+  }
+
+  // the phases above only record their draws, the gpu work happens here
+  profiler_begin(&profiler, FRAME_PHASE_FLUSH);
+  zephr_flush_draws();
+  profiler_end(&profiler, FRAME_PHASE_FLUSH);
+}
+
+void swap_frame(void) {
+  profiler_begin(&profiler, FRAME_PHASE_SWAP);
+  zephr_swap_buffers();
+  profiler_end(&profiler, FRAME_PHASE_SWAP);
+  profiler_end_frame(&profiler);
+}
+
+// marks the snapshots published from now on as reflecting the input, until
+// the render thread takes one of them
+void note_input(const ZephrEvent *event) {
+  if (pending_input_ms < 0.0 || event->received_ms < pending_input_ms) {
+    pending_input_ms = event->received_ms;
+  }
+}
+
+u64 publish_snapshot(const Cudoku *game, int frame, bool quit) {
+  if (pending_input_sequence != 0 && snapshot_buffer_read_sequence(&snapshots) >= pending_input_sequence) {
+    pending_input_ms = -1.0;
+    pending_input_sequence = 0;
+  }
+
+  FrameSnapshot *snapshot = snapshot_buffer_write_slot(&snapshots);
+  snapshot->game = *game;
+  snapshot->settings = settings;
+  snapshot->time = get_time();
+  snapshot->input_ms = pending_input_ms;
+  snapshot->frame = frame;
+  snapshot->quit = quit;
+  u64 sequence = snapshot_buffer_publish(&snapshots);
+
+  // taking the lock orders the signal after the waiter checked for a snapshot,
+  // so it can't be missed
+  pthread_mutex_lock(&snapshot_mutex);
+  pthread_cond_signal(&snapshot_published);
+  pthread_mutex_unlock(&snapshot_mutex);
+
+  if (pending_input_ms >= 0.0 && pending_input_sequence == 0) {
+    pending_input_sequence = sequence;
+  }
+
+  return sequence;
+}
+
+// whether any of the keys is pressed by the query. w with ctrl or shift is
+// the debug win rather than a move
+bool move_keys_query(const MoveKeys *move, bool (*query)(ZephrKeycode keycode)) {
+  bool is_modified =
+    zephr_keyboard_keycode_is_pressed(ZEPHR_KEYCODE_LEFT_CTRL) ||
+    zephr_keyboard_keycode_is_pressed(ZEPHR_KEYCODE_RIGHT_CTRL) ||
+    zephr_keyboard_keycode_is_pressed(ZEPHR_KEYCODE_LEFT_SHIFT) ||
+    zephr_keyboard_keycode_is_pressed(ZEPHR_KEYCODE_RIGHT_SHIFT);
+
+  for (u32 i = 0; i < CORE_ARRAY_COUNT(move->keys); i++) {
+    if (move->keys[i] == ZEPHR_KEYCODE_W && is_modified) continue;
+    if (query(move->keys[i])) return true;
+  }
+  return false;
+}
+
+// moves the selection with the direction keys, once when they go down and
+// then repeatedly for as long as they're held. returns whether it moved
+bool update_held_moves(Cudoku *game, double now) {
+  int x = 0;
+  int y = 0;
+  bool has_been_pressed = false;
+
+  for (u32 i = 0; i < CORE_ARRAY_COUNT(move_keys); i++) {
+    if (move_keys_query(&move_keys[i], zephr_keyboard_keycode_has_been_pressed)) {
+      x += move_keys[i].x;
+      y += move_keys[i].y;
+      has_been_pressed = true;
+    }
+  }
+
+  // a new press moves right away, even if the key was released again since
+  if (has_been_pressed) {
+    move_selection(game, x, y);
+    next_move_time = now + MOVE_REPEAT_DELAY_S;
+    return true;
+  }
+
+  for (u32 i = 0; i < CORE_ARRAY_COUNT(move_keys); i++) {
+    if (move_keys_query(&move_keys[i], zephr_keyboard_keycode_is_pressed)) {
+      x += move_keys[i].x;
+      y += move_keys[i].y;
+    }
+  }
+
+  if (x == 0 && y == 0) {
+    next_move_time = -1.0;
+    return false;
+  }
+  if (next_move_time < 0.0 || now < next_move_time) return false;
+
+  move_selection(game, x, y);
+  // after a stall the repeats carry on from now rather than catching up
+  next_move_time = CORE_MAX(next_move_time + MOVE_REPEAT_INTERVAL_S, now);
+  return true;
+}
+
+// how long the game thread can sleep before it has something to do, negative
+// when only input can change anything
+double game_wait_ms(Cudoku *game, bool is_animating) {
+  double wait_ms = -1.0;
+
+  if (is_animating) {
+    wait_ms = (1.0 / GAME_UPDATE_HZ - update_accumulator) * 1000.0;
+  } else {
+    double until_change = time_until_shown_change(game);
+    if (until_change >= 0.0) wait_ms = until_change * 1000.0;
+  }
+
+  if (next_move_time >= 0.0) {
+    double until_move_ms = CORE_MAX(next_move_time - get_time(), 0.0) * 1000.0;
+    wait_ms = wait_ms < 0.0 ? until_move_ms : CORE_MIN(wait_ms, until_move_ms);
+  }
+
+  return wait_ms;
+}
+
+// runs as many fixed updates as fit in the time since the last call, the rest
+// is carried over to the next one. returns whether any of them animated
+bool advance_game(Cudoku *game, double now) {
+  if (last_update_time < 0.0) last_update_time = now;
+  update_accumulator += CORE_MIN(now - last_update_time, GAME_MAX_CATCH_UP_S);
+  last_update_time = now;
+
+  const double dt = 1.0 / GAME_UPDATE_HZ;
+  bool is_animating = false;
+  while (update_accumulator >= dt) {
+    is_animating |= update_game(game, (float)dt);
+    update_accumulator -= dt;
+  }
+
+  return is_animating;
+}
+
+bool pacing_settings_changed(const RenderSettings *a, const RenderSettings *b) {
+  return a->present_mode != b->present_mode || a->frame_cap_hz != b->frame_cap_hz || a->render_late != b->render_late;
+}
+
+// owns the context and draws the snapshots published by the game thread, which
+// only publishes one when something on screen changed. in a window the latest
+// snapshot is drawn at the pace of the present mode, and only when it's new
+// unless the profiler is shown, which is redrawn every frame to stay live.
+// headless every snapshot is drawn exactly once and its checksum printed, so
+// that the scripted frames are deterministic
+void *render_main(void *arg) {
+  CORE_UNUSED(arg);
+  bool headless = zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS;
+  RenderSettings applied_settings = {0};
+  bool has_applied_settings = false;
+  double reflected_input_ms = -1.0;
+  bool is_continuous = false;
+  int drawn_frames = 0;
+
+#if ZEPHR_GL_STATS
+  if (gl_stats_out) {
+    fprintf(gl_stats_out, "frame,draw_calls,state_changes,uniform_updates,program_switches,uploaded_bytes,errors\n");
+  }
+#endif
+
+  zephr_make_context_current(true);
+
+  for (;;) {
+    const FrameSnapshot *snapshot = NULL;
+    bool is_new = false;
+
+    while (headless && !is_new) {
+      snapshot = snapshot_buffer_read(&snapshots, &is_new);
+      if (!is_new) sched_yield();
+    }
+
+    // a window that's idle isn't redrawn, the last frame stays on screen
+    if (!headless && !is_continuous) {
+      pthread_mutex_lock(&snapshot_mutex);
+      while (!snapshot_buffer_has_new(&snapshots)) {
+        pthread_cond_wait(&snapshot_published, &snapshot_mutex);
+      }
+      pthread_mutex_unlock(&snapshot_mutex);
+    }
+
+    zephr_begin_frame();
+
+    profiler_begin(&profiler, FRAME_PHASE_SNAPSHOT);
+    if (!headless) {
+      // taken after the frame began so that with render late it's the
+      // latest state right before the frame is due
+      snapshot = snapshot_buffer_read(&snapshots, &is_new);
+    }
+
+    if (snapshot->quit) {
+      profiler_end(&profiler, FRAME_PHASE_SNAPSHOT);
+      break;
+    }
+
+    if (!has_applied_settings || pacing_settings_changed(&applied_settings, &snapshot->settings)) {
+      if (has_applied_settings) profiler_print_report(&profiler);
+      apply_frame_pacing(&snapshot->settings);
+      applied_settings = snapshot->settings;
+      has_applied_settings = true;
+    }
+    profiler.show_overlay = snapshot->settings.show_profiler;
+    is_continuous = snapshot->settings.show_profiler;
+
+    zephr_resize(snapshot->game.layout.window_size);
+    set_fixed_time(snapshot->time);
+    if (snapshot->input_ms > reflected_input_ms) {
+      zephr_frame_reflects_event(&(ZephrEvent){ .received_ms = snapshot->input_ms });
+      reflected_input_ms = snapshot->input_ms;
+    }
+
+    // the draw functions take the game by pointer, so they get a copy to keep
+    // the snapshot untouched
+    Cudoku game = snapshot->game;
+    profiler_end(&profiler, FRAME_PHASE_SNAPSHOT);
+
+    draw_frame(&game);
+
+    if (headless) {
+      // the readback is timed as part of the swap phase
+      profiler_begin(&profiler, FRAME_PHASE_SWAP);
+      printf("frame %04d %016llx\n", snapshot->frame, (unsigned long long)zephr_frame_checksum());
+      if (dump_dir) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/frame_%04d.%s", dump_dir, snapshot->frame, dump_format);
+        if (!zephr_save_frame(path)) {
+          // the frames are still drawn for the checksums
+          dump_failed = true;
+          dump_dir = NULL;
+        }
+      }
+      profiler_end(&profiler, FRAME_PHASE_SWAP);
+    }
+
+    swap_frame();
+    if (drawn_frames == 0) startup_trace_end();
+
+#if ZEPHR_GL_STATS
+    if (gl_stats_out) {
+      GLStats gl = gl_stats_last_frame;
+      fprintf(gl_stats_out, "%d,%d,%d,%d,%d,%llu,%d\n", drawn_frames, gl.draw_calls_count, gl.state_changes_count,
+          gl.uniform_updates_count, gl.program_switches_count, (unsigned long long)gl.uploaded_bytes, gl.errors_count);
+    }
+#endif
+    drawn_frames++;
+  }
+
+  zephr_make_context_current(false);
+
+  return NULL;
+}
+
+pthread_t render_thread;
+
+void start_render_thread(void) {
+  // the context can only be current on one thread at once
+  zephr_make_context_current(false);
+
+  int err = pthread_create(&render_thread, NULL, render_main, NULL);
+  CORE_ASSERT(err == 0, "failed to start the render thread: %s", strerror(err));
+}
+
+// the context is current on the calling thread again once this returns
+void stop_render_thread(const Cudoku *game) {
+  publish_snapshot(game, -1, true);
+  pthread_join(render_thread, NULL);
+
+  zephr_make_context_current(true);
+}
+
+// plays a fixed game at 60 fps of simulated time so that every run renders
+// the same frames: the help is shown first, then a few numbers are placed
+// with the mistakes highlighted and the last third is the win screen.
+// every frame's checksum is printed and optionally the frame is saved, then
+// the profile of the run is printed
+int run_headless(int frames_count, Size window_size) {
+  set_fixed_time(0.0);
+
+  Cudoku game = first_game;
+  update_layout(&game, window_size);
+
+  timer_start(&game.help_timer, 5.0f);
+  timer_start(&game.timer, 0.0f);
+
+  start_render_thread();
+
+  for (int frame = 0; frame < frames_count && !zephr_update(); frame++) {
+    set_fixed_time(frame / 60.0);
+
+    // the scripted moves stand in for input that arrived at the start of the frame
+    ZephrEvent scripted_input = { .type = ZEPHR_EVENT_KEY_PRESSED, .received_ms = zephr_now_ms() };
+
+    if (frame == frames_count / 3) {
+      note_input(&scripted_input);
+      game.should_draw_help = false;
+      game.should_highlight_mistakes = true;
+      for (int i = 0; i < 9; i++) {
+        game.selection = (Vec2){ i, i };
+        game.should_draw_selection = true;
+        set_selected_number(&game, i + 1);
+      }
+    } else if (frame == frames_count * 2 / 3) {
+      note_input(&scripted_input);
+      game.has_won = true;
+      game.should_draw_selection = false;
+      game.should_highlight_mistakes = false;
+      game.win_time = get_time();
+      timer_stop(&game.timer);
+    }
+
+    // two fixed updates per frame of simulated time
+    advance_game(&game, get_time());
+
+    // every frame is drawn before the next one is scripted
+    u64 sequence = publish_snapshot(&game, frame, false);
+    while (snapshot_buffer_read_sequence(&snapshots) < sequence) {
+      sched_yield();
+    }
+  }
+
+  stop_render_thread(&game);
+  profiler_print_report(&profiler);
+
+  return dump_failed ? 1 : 0;
+}
+
+int generate_first_game(void *arg) {
+  CORE_UNUSED(arg);
+
+  srand(first_game_seed);
+  first_game.should_draw_help = true;
+  generate_random_board(&first_game);
+
+  return 0;
+}
+
+void print_startup(void) {
+  startup_print_report();
+  if (startup_trace_out && startup_trace_write(startup_trace_out)) {
+    printf("[INFO] Wrote the startup trace to %s\n", startup_trace_out);
+  }
+}
+
+void print_latency(void) {
+  zephr_print_latency_report();
+  if (latency_out && zephr_export_latency(latency_out)) {
+    printf("[INFO] Exported the input latency to %s\n", latency_out);
   }
 }
 
 int main(int argc, char *argv[]) {
+  startup_trace_begin();
+
+  Size window_size = {900, 900};
+
   if (argc > 1) {
     char *flag = argv[1];
     if (strcmp(flag, "-h") == 0 || strcmp(flag, "--help") == 0) {
@@ -108,84 +650,210 @@ int main(int argc, char *argv[]) {
         } else {
           printf("[WARN]: Used font flag with no provided font, defaulting to Rubik\n");
         }
+      } else if (strcmp(option, "--size") == 0) {
+        Size size = {0};
+        if (i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0) {
+          window_size = size;
+          i++;
+        } else {
+          printf("[WARN]: Used size flag without <width>x<height>, defaulting to 900x900\n");
+        }
+      } else if (strcmp(option, "--sdf") == 0) {
+        font_render_mode = FONT_RENDER_MODE_SDF;
+      } else if (strcmp(option, "--profile") == 0) {
+        settings.show_profiler = true;
+      } else if (strcmp(option, "--present-mode") == 0) {
+        const char *mode = i + 1 < argc ? argv[i + 1] : "";
+        int mode_idx = 0;
+        while (mode_idx < ZEPHR_PRESENT_MODES_COUNT && strcmp(mode, zephr_present_mode_name(mode_idx)) != 0) {
+          mode_idx++;
+        }
+        if (mode_idx < ZEPHR_PRESENT_MODES_COUNT) {
+          settings.present_mode = mode_idx;
+          i++;
+        } else {
+          printf("[WARN]: Used present mode flag without vsync, adaptive, uncapped or capped, defaulting to vsync\n");
+        }
+      } else if (strcmp(option, "--frame-cap") == 0) {
+        if (i + 1 < argc && atof(argv[i + 1]) > 0.0) {
+          settings.frame_cap_hz = atof(argv[i + 1]);
+          settings.present_mode = ZEPHR_PRESENT_MODE_CAPPED;
+          i++;
+        } else {
+          printf("[WARN]: Used frame cap flag with no valid frame rate, not capping\n");
+        }
+      } else if (strcmp(option, "--aa") == 0) {
+        const char *mode = i + 1 < argc ? argv[i + 1] : "";
+        int mode_idx = 0;
+        while (mode_idx < ZEPHR_ANTI_ALIASING_MODES_COUNT && strcmp(mode, zephr_anti_aliasing_name(mode_idx)) != 0) {
+          mode_idx++;
+        }
+        if (mode_idx < ZEPHR_ANTI_ALIASING_MODES_COUNT) {
+          anti_aliasing = mode_idx;
+          i++;
+        } else {
+          printf("[WARN]: Used aa flag without none, analytic, msaa2, msaa4 or msaa8, defaulting to analytic\n");
+        }
+      } else if (strcmp(option, "--render-late") == 0) {
+        settings.render_late = true;
+      } else if (strcmp(option, "--latency-out") == 0) {
+        if (i + 1 < argc) {
+          latency_out = argv[i + 1];
+          i++;
+        } else {
+          printf("[WARN]: Used latency out flag with no path, not exporting the latency\n");
+        }
+#if ZEPHR_GL_STATS
+      } else if (strcmp(option, "--gl-stats-out") == 0) {
+        if (i + 1 < argc) {
+          gl_stats_out = fopen(argv[i + 1], "w");
+          if (!gl_stats_out) {
+            printf("[WARN]: Failed to open \"%s\", not writing the gl stats\n", argv[i + 1]);
+          }
+          i++;
+        } else {
+          printf("[WARN]: Used gl stats out flag with no path, not writing the gl stats\n");
+        }
+#endif
+      } else if (strcmp(option, "--startup-trace") == 0) {
+        if (i + 1 < argc) {
+          startup_trace_out = argv[i + 1];
+          i++;
+        } else {
+          printf("[WARN]: Used startup trace flag with no path, not writing the startup trace\n");
+        }
+      } else if (strcmp(option, "--headless") == 0) {
+        if (i + 1 < argc) {
+          headless_frames = atoi(argv[i + 1]);
+          i++;
+        } else {
+          printf("[WARN]: Used headless flag with no frame count, rendering 1 frame\n");
+          headless_frames = 1;
+        }
+      } else if (strcmp(option, "--dump") == 0) {
+        if (i + 1 < argc) {
+          dump_dir = argv[i + 1];
+          i++;
+        } else {
+          printf("[WARN]: Used dump flag with no directory, not dumping frames\n");
+        }
+      } else if (strcmp(option, "--dump-format") == 0) {
+        if (i + 1 < argc && (strcmp(argv[i + 1], "png") == 0 || strcmp(argv[i + 1], "ppm") == 0)) {
+          dump_format = argv[i + 1];
+          i++;
+        } else {
+          printf("[WARN]: Used dump format flag without png or ppm, defaulting to png\n");
+        }
       }
     }
   }
 
-  Size window_size = {900, 900};
-  int res = init_zephr(font_path, title, window_size);
+  ZephrBackend backend = headless_frames >= 0 ? ZEPHR_BACKEND_HEADLESS : ZEPHR_BACKEND_X11;
+
+  // headless runs always play the same board
+  first_game_seed = backend == ZEPHR_BACKEND_HEADLESS ? 1 : (unsigned int)time(NULL);
+  StartupTask first_game_task = { .name = "puzzle", .run = generate_first_game };
+  startup_task_start(&first_game_task);
+
+  int res = init_zephr(font_path, font_render_mode, title, window_size, backend, anti_aliasing);
+  startup_task_wait(&first_game_task);
   if (res != 0) {
     printf("[ERROR]: could not initialize zephr\n");
     return 1;
   }
-  zephr_make_window_non_resizable();
+  profiler_init(&profiler, frame_phase_names, FRAME_PHASES_COUNT);
+  snapshot_buffer_init(&snapshots, sizeof(FrameSnapshot));
 
-  srand(time(NULL));
+  if (backend == ZEPHR_BACKEND_HEADLESS) {
+    res = run_headless(headless_frames, window_size);
+    print_startup();
+    print_latency();
+#if ZEPHR_GL_STATS
+    if (gl_stats_out) fclose(gl_stats_out);
+#endif
+    snapshot_buffer_deinit(&snapshots);
+    profiler_deinit(&profiler);
+    deinit_zephr();
+    return res;
+  }
 
-  Cudoku game = {0};
-  game.should_draw_help = true;
-  generate_random_board(&game);
+  Cudoku game = first_game;
+  update_layout(&game, zephr_get_window_size());
 
   timer_start(&game.help_timer, 5.0f);
   timer_start(&game.timer, 0.0f);
 
-  while (!zephr_should_quit()) {
-    ZephrEvent event;
+  // the render thread always has a snapshot to draw
+  publish_snapshot(&game, 0, false);
+  start_render_thread();
+
+  u64 shown_time = shown_time_key(&game);
+
+  while (!zephr_update()) {
+    // a snapshot is only published when the frame would look different, so
+    // an idle game doesn't draw at all
+    const ZephrEvent *events;
+    u32 events_count = zephr_poll_events(&events);
+    bool is_dirty = events_count > 0;
+
+    for (u32 i = 0; i < events_count; i++) {
+      const ZephrEvent *event = &events[i];
 
-    while (zephr_iter_events(&event)) {
-      switch (event.type) {
+      switch (event->type) {
         case ZEPHR_EVENT_UNKNOWN:
           printf("[WARN]: Unknown event\n");
           break;
         case ZEPHR_EVENT_KEY_PRESSED:
-          handle_keypress(event, &game);
+          handle_keypress(*event, &game);
+          if (!event->key.is_repeat) note_input(event);
           break;
         case ZEPHR_EVENT_MOUSE_BUTTON_PRESSED:
-          if (event.mouse.button == ZEPHR_MOUSE_BUTTON_LEFT) {
-            do_selection(&game, event.mouse.position.x, event.mouse.position.y);
+          if (event->mouse.button == ZEPHR_MOUSE_BUTTON_LEFT) {
+            do_selection(&game, event->mouse.position.x, event->mouse.position.y);
+            note_input(event);
           }
           break;
         case ZEPHR_EVENT_WINDOW_CLOSED:
           zephr_quit();
           break;
-        default:
         case ZEPHR_EVENT_WINDOW_RESIZED:
+          update_layout(&game, (Size){ event->window.width, event->window.height });
+          break;
+        default:
         case ZEPHR_EVENT_KEY_RELEASED:
           break;
         }
     }
 
-    draw_board(&game, window_size);
-    draw_timer(&game.timer);
+    is_dirty |= update_held_moves(&game, get_time());
 
-    if (game.should_draw_selection) {
-      draw_selection_box(game.selection.y, game.selection.x, (Color){102, 102, 255, 127});
-    }
+    bool is_animating = advance_game(&game, get_time());
+    is_dirty |= is_animating;
 
-    if (game.should_highlight_mistakes) {
-      draw_mistakes_highlight(&game);
-    }
-
-    if (timer_ended(&game.help_timer)) {
-      timer_stop(&game.help_timer);
-      game.should_draw_help = false;
+    u64 new_shown_time = shown_time_key(&game);
+    if (new_shown_time != shown_time) {
+      shown_time = new_shown_time;
+      is_dirty = true;
     }
 
-    if (game.should_draw_help) {
-      draw_help(&game.help_timer);
+    if (is_dirty) {
+      publish_snapshot(&game, 0, false);
     }
 
-    if (game.has_won) {
-      draw_win(&game);
-    }
-
-    if (game.timer.state == TIMER_PAUSED) {
-      draw_pause_overlay();
-    }
-
-    zephr_swap_buffers();
+    // sleeps until there's input, a tween to advance or a clock to tick
+    zephr_wait_events(game_wait_ms(&game, is_animating));
   }
 
+  stop_render_thread(&game);
+
+  profiler_print_report(&profiler);
+  print_startup();
+  print_latency();
+#if ZEPHR_GL_STATS
+  if (gl_stats_out) fclose(gl_stats_out);
+#endif
+  snapshot_buffer_deinit(&snapshots);
+  profiler_deinit(&profiler);
   deinit_zephr();
 
   return 0;
@@ -0,0 +1,316 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glad/gl.h>
+
+#include "gl_stats.h"
+#include "profiler.h"
+#include "text.h"
+#include "ui.h"
+#include "zephr.h"
+
+#define PROFILER_FONT_SIZE 16
+#define PROFILER_LINE_HEIGHT 20
+#define PROFILER_PADDING 8
+#define PROFILER_WIDTH 320
+#define PROFILER_GRAPH_HEIGHT 60
+#define PROFILER_BAR_WIDTH 2
+
+double profiler_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void profiler_reset(Profiler *profiler) {
+  for (int i = 0; i < profiler->phases_count; i++) {
+    ProfilerPhase *phase = &profiler->phases[i];
+    // pending results are dropped, reusing a query before its result was
+    // read back is fine
+    for (int j = 0; j < PROFILER_QUERY_RING_SIZE; j++) {
+      phase->query_frames[j] = -1;
+    }
+    for (int j = 0; j < PROFILER_HISTORY_SIZE; j++) {
+      phase->cpu_ms[j] = -1.f;
+      phase->gpu_ms[j] = -1.f;
+    }
+  }
+
+  for (int i = 0; i < PROFILER_HISTORY_SIZE; i++) {
+    profiler->frame_ms[i] = -1.f;
+  }
+
+  profiler->frame_start = profiler_now_ms();
+}
+
+void profiler_init(Profiler *profiler, const char **phase_names, int phases_count) {
+  CORE_ASSERT(phases_count <= PROFILER_MAX_PHASES, "profiler supports at most %d phases", PROFILER_MAX_PHASES);
+
+  CORE_ZERO_ELMT(profiler);
+  profiler->phases_count = phases_count;
+  profiler->active_phase = -1;
+  profiler->budget_ms = 1000.f / 60.f;
+
+  for (int i = 0; i < phases_count; i++) {
+    ProfilerPhase *phase = &profiler->phases[i];
+    phase->name = phase_names[i];
+    glGenQueries(PROFILER_QUERY_RING_SIZE, phase->queries);
+  }
+
+  profiler_reset(profiler);
+}
+
+void profiler_deinit(Profiler *profiler) {
+  for (int i = 0; i < profiler->phases_count; i++) {
+    glDeleteQueries(PROFILER_QUERY_RING_SIZE, profiler->phases[i].queries);
+  }
+}
+
+// reads the result of the query if it's ready. returns false if it isn't
+bool collect_query(ProfilerPhase *phase, int slot) {
+  int available = 0;
+  glGetQueryObjectiv(phase->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) return false;
+
+  u64 elapsed_ns = 0;
+  glGetQueryObjectui64v(phase->queries[slot], GL_QUERY_RESULT, &elapsed_ns);
+  phase->gpu_ms[phase->query_frames[slot] % PROFILER_HISTORY_SIZE] = (float)(elapsed_ns / 1000000.0);
+  phase->query_frames[slot] = -1;
+
+  return true;
+}
+
+void profiler_begin(Profiler *profiler, int phase_idx) {
+  CORE_DEBUG_ASSERT(profiler->active_phase == -1, "profiler phase '%s' is still active", profiler->phases[profiler->active_phase].name);
+
+  ProfilerPhase *phase = &profiler->phases[phase_idx];
+  int slot = profiler->frame % PROFILER_QUERY_RING_SIZE;
+
+  // a phase that runs more than once a frame only gets the gpu time of its
+  // first run, the query of this frame is left alone until it's collected
+  bool is_rerun = phase->query_frames[slot] == (i64)profiler->frame;
+
+  // the query from a ring ago wasn't ready at the end of any frame since,
+  // give it one last chance and drop it otherwise so that we never stall
+  if (!is_rerun && phase->query_frames[slot] != -1 && !collect_query(phase, slot)) {
+    phase->query_frames[slot] = -1;
+  }
+
+  if (!is_rerun && phase->query_frames[slot] == -1) {
+    glBeginQuery(GL_TIME_ELAPSED, phase->queries[slot]);
+    phase->query_frames[slot] = (i64)profiler->frame;
+    phase->query_active = true;
+  }
+
+  profiler->active_phase = phase_idx;
+  phase->cpu_start = profiler_now_ms();
+}
+
+void profiler_end(Profiler *profiler, int phase_idx) {
+  ProfilerPhase *phase = &profiler->phases[phase_idx];
+
+  // phases that didn't run in a frame have no sample rather than a zero one
+  float *cpu_ms = &phase->cpu_ms[profiler->frame % PROFILER_HISTORY_SIZE];
+  *cpu_ms = CORE_MAX(*cpu_ms, 0.f) + (float)(profiler_now_ms() - phase->cpu_start);
+
+  if (phase->query_active) {
+    glEndQuery(GL_TIME_ELAPSED);
+    phase->query_active = false;
+  }
+
+  profiler->active_phase = -1;
+}
+
+void profiler_end_frame(Profiler *profiler) {
+  double now = profiler_now_ms();
+  profiler->frame_ms[profiler->frame % PROFILER_HISTORY_SIZE] = (float)(now - profiler->frame_start);
+  profiler->frame_start = now;
+
+  for (int i = 0; i < profiler->phases_count; i++) {
+    ProfilerPhase *phase = &profiler->phases[i];
+    for (int slot = 0; slot < PROFILER_QUERY_RING_SIZE; slot++) {
+      if (phase->query_frames[slot] != -1) {
+        collect_query(phase, slot);
+      }
+    }
+  }
+
+  profiler->frame++;
+
+  int idx = profiler->frame % PROFILER_HISTORY_SIZE;
+  for (int i = 0; i < profiler->phases_count; i++) {
+    profiler->phases[i].cpu_ms[idx] = -1.f;
+    profiler->phases[i].gpu_ms[idx] = -1.f;
+  }
+}
+
+int compare_floats(const void *a, const void *b) {
+  float fa = *(const float *)a;
+  float fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
+// the stats of the samples in a history, skipping the ones that are negative
+ProfilerStats profiler_stats(const float *samples) {
+  float sorted[PROFILER_HISTORY_SIZE];
+  int count = 0;
+  float total = 0.f;
+  for (int i = 0; i < PROFILER_HISTORY_SIZE; i++) {
+    if (samples[i] < 0.f) continue;
+    sorted[count++] = samples[i];
+    total += samples[i];
+  }
+
+  if (count == 0) return (ProfilerStats){0};
+
+  qsort(sorted, count, sizeof(float), compare_floats);
+
+  int p99_idx = CORE_MIN(count - 1, (int)(count * 0.99f));
+  float avg = total / count;
+
+  float variance = 0.f;
+  for (int i = 0; i < count; i++) {
+    variance += (sorted[i] - avg) * (sorted[i] - avg);
+  }
+
+  return (ProfilerStats){
+    .min = sorted[0],
+    .avg = avg,
+    .p99 = sorted[p99_idx],
+    .max = sorted[count - 1],
+    .stddev = sqrtf(variance / count),
+    .samples_count = count,
+  };
+}
+
+// frames are allowed to run a little over the budget since the swap returns
+// a bit after the vertical blank it waited for
+bool profiler_is_over_budget(Profiler *profiler, float ms) {
+  return ms > profiler->budget_ms * 1.2f;
+}
+
+void profiler_draw_overlay(Profiler *profiler) {
+  Color const bg_color = { 0.f, 0.f, 0.f, 200.f };
+  Color const text_color = { 237.f, 255.f, 255.f, 255.f };
+  Color const bar_color = { 100.f, 220.f, 100.f, 255.f };
+  Color const slow_bar_color = { 255.f, 80.f, 80.f, 255.f };
+  Color const target_color = { 255.f, 255.f, 255.f, 120.f };
+
+  renderer_set_layer(&zephr_ctx.renderer, RENDER_LAYER_TOP);
+
+  int lines_count = profiler->phases_count + 4 + ZEPHR_GL_STATS;
+  float width = PROFILER_WIDTH;
+  float height = lines_count * PROFILER_LINE_HEIGHT + PROFILER_GRAPH_HEIGHT + PROFILER_PADDING * 3;
+  float x = zephr_ctx.window.size.width - width;
+
+  UIConstraints constraints = {0};
+  set_x_constraint(&constraints, x, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&constraints, 0, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, width, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, height, UI_CONSTRAINT_FIXED);
+  draw_quad(constraints, &bg_color, 0.0, ALIGN_TOP_LEFT);
+
+  GlyphInstanceList batch;
+  new_glyph_instance_list(&batch, 64 * lines_count);
+
+  char line[128];
+  set_width_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
+  set_x_constraint(&constraints, x + PROFILER_PADDING, UI_CONSTRAINT_FIXED);
+
+  set_y_constraint(&constraints, PROFILER_PADDING, UI_CONSTRAINT_FIXED);
+  add_text_instance(&batch, profiler->title, PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+
+  ProfilerStats frame_stats = profiler_stats(profiler->frame_ms);
+  snprintf(line, sizeof(line), "frame  avg %.2f  p99 %.2f  sd %.2f ms",
+      frame_stats.avg, frame_stats.p99, frame_stats.stddev);
+  set_y_constraint(&constraints, PROFILER_PADDING + PROFILER_LINE_HEIGHT, UI_CONSTRAINT_FIXED);
+  add_text_instance(&batch, line, PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+
+  set_y_constraint(&constraints, PROFILER_PADDING + PROFILER_LINE_HEIGHT * 2, UI_CONSTRAINT_FIXED);
+  add_text_instance(&batch, "phase  cpu avg/p99  gpu avg/p99 ms", PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+
+  for (int i = 0; i < profiler->phases_count; i++) {
+    ProfilerPhase *phase = &profiler->phases[i];
+    ProfilerStats cpu = profiler_stats(phase->cpu_ms);
+    ProfilerStats gpu = profiler_stats(phase->gpu_ms);
+    snprintf(line, sizeof(line), "%s  %.2f/%.2f  %.2f/%.2f", phase->name, cpu.avg, cpu.p99, gpu.avg, gpu.p99);
+    set_y_constraint(&constraints, PROFILER_PADDING + PROFILER_LINE_HEIGHT * (i + 3), UI_CONSTRAINT_FIXED);
+    add_text_instance(&batch, line, PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+  }
+
+  // the stats of the last flushed frame, since this one is still being recorded
+  RendererStats render_stats = zephr_ctx.renderer.stats;
+  snprintf(line, sizeof(line), "draws  %d commands  %d calls  %d programs  %.0f%% redrawn",
+      render_stats.commands_count, render_stats.draw_calls_count, render_stats.program_switches_count,
+      render_stats.redrawn_fraction * 100.f);
+  set_y_constraint(&constraints, PROFILER_PADDING + PROFILER_LINE_HEIGHT * (profiler->phases_count + 3), UI_CONSTRAINT_FIXED);
+  add_text_instance(&batch, line, PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+
+#if ZEPHR_GL_STATS
+  GLStats gl = gl_stats_last_frame;
+  snprintf(line, sizeof(line), "gl  %d draws  %d state  %d uniforms  %d programs  %.1f KB",
+      gl.draw_calls_count, gl.state_changes_count, gl.uniform_updates_count, gl.program_switches_count,
+      gl.uploaded_bytes / 1024.0);
+  set_y_constraint(&constraints, PROFILER_PADDING + PROFILER_LINE_HEIGHT * (profiler->phases_count + 4), UI_CONSTRAINT_FIXED);
+  add_text_instance(&batch, line, PROFILER_FONT_SIZE, constraints, &text_color, ALIGN_TOP_LEFT);
+#endif
+
+  draw_text_batch(&batch);
+
+  // frame time graph, oldest frame on the left. it tops out at two budgets
+  float graph_max_ms = profiler->budget_ms * 2.f;
+  float graph_y = PROFILER_PADDING * 2 + lines_count * PROFILER_LINE_HEIGHT;
+  float graph_bottom = graph_y + PROFILER_GRAPH_HEIGHT;
+  for (int i = 0; i < PROFILER_HISTORY_SIZE; i++) {
+    float ms = profiler->frame_ms[(profiler->frame + 1 + i) % PROFILER_HISTORY_SIZE];
+    if (ms < 0.f) continue;
+
+    float bar_height = CORE_MIN(ms / graph_max_ms, 1.f) * PROFILER_GRAPH_HEIGHT;
+    set_x_constraint(&constraints, x + PROFILER_PADDING + i * PROFILER_BAR_WIDTH, UI_CONSTRAINT_FIXED);
+    set_y_constraint(&constraints, graph_bottom - bar_height, UI_CONSTRAINT_FIXED);
+    set_width_constraint(&constraints, PROFILER_BAR_WIDTH, UI_CONSTRAINT_FIXED);
+    set_height_constraint(&constraints, bar_height, UI_CONSTRAINT_FIXED);
+    draw_quad(constraints, profiler_is_over_budget(profiler, ms) ? &slow_bar_color : &bar_color, 0.0, ALIGN_TOP_LEFT);
+  }
+
+  // the frame budget
+  set_x_constraint(&constraints, x + PROFILER_PADDING, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&constraints, graph_bottom - PROFILER_GRAPH_HEIGHT / 2.f, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&constraints, PROFILER_HISTORY_SIZE * PROFILER_BAR_WIDTH, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&constraints, 1, UI_CONSTRAINT_FIXED);
+  draw_quad(constraints, &target_color, 0.0, ALIGN_TOP_LEFT);
+}
+
+void profiler_print_report(Profiler *profiler) {
+  ProfilerStats frame_stats = profiler_stats(profiler->frame_ms);
+  printf("[INFO] Profile of the last %d frames (ms), %s\n", frame_stats.samples_count, profiler->title);
+  printf("  %-12s %8s %8s %8s   %8s %8s %8s\n", "phase", "cpu min", "cpu avg", "cpu p99", "gpu min", "gpu avg", "gpu p99");
+
+  for (int i = 0; i < profiler->phases_count; i++) {
+    ProfilerPhase *phase = &profiler->phases[i];
+    ProfilerStats cpu = profiler_stats(phase->cpu_ms);
+    ProfilerStats gpu = profiler_stats(phase->gpu_ms);
+    printf("  %-12s %8.3f %8.3f %8.3f   %8.3f %8.3f %8.3f\n", phase->name,
+        cpu.min, cpu.avg, cpu.p99, gpu.min, gpu.avg, gpu.p99);
+  }
+
+  printf("  %-12s %8.3f %8.3f %8.3f\n", "frame", frame_stats.min, frame_stats.avg, frame_stats.p99);
+
+  int missed_count = 0;
+  for (int i = 0; i < PROFILER_HISTORY_SIZE; i++) {
+    if (profiler->frame_ms[i] >= 0.f && profiler_is_over_budget(profiler, profiler->frame_ms[i])) {
+      missed_count++;
+    }
+  }
+  printf("  frame max %.3f, stddev %.3f, %d of %d over the %.2fms budget\n",
+      frame_stats.max, frame_stats.stddev, missed_count, frame_stats.samples_count, profiler->budget_ms);
+
+  // how close the frames came to running out of the frame arena
+  CoreArena *arena = &zephr_ctx.frame_arena;
+  printf("  frame arena peak %zu of %zu bytes, at most %u allocations in a frame\n",
+      arena->high_water_mark, arena->capacity, CORE_MAX(arena->most_allocations_count, arena->allocations_count));
+}
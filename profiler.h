@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "core.h"
+
+#define PROFILER_MAX_PHASES 8
+// the stats and the graph cover this many of the last frames
+#define PROFILER_HISTORY_SIZE 120
+// gpu timings are read back this many frames after they were issued at the
+// latest. a query that still isn't ready by then is dropped instead of waited on
+#define PROFILER_QUERY_RING_SIZE 4
+
+typedef struct ProfilerPhase {
+  const char *name;
+  double cpu_start;
+  float cpu_ms[PROFILER_HISTORY_SIZE];
+  // -1 until the timer query of that frame is read back
+  float gpu_ms[PROFILER_HISTORY_SIZE];
+  unsigned int queries[PROFILER_QUERY_RING_SIZE];
+  // the frame each query was issued in, -1 if it has no pending result
+  i64 query_frames[PROFILER_QUERY_RING_SIZE];
+  // whether the current run of the phase began a query
+  bool query_active;
+} ProfilerPhase;
+
+// times the phases of a frame on the cpu and, with GL_TIME_ELAPSED queries,
+// on the gpu. phases may not overlap since only one time elapsed query can be
+// active at once
+typedef struct Profiler {
+  ProfilerPhase phases[PROFILER_MAX_PHASES];
+  int phases_count;
+  int active_phase;
+  float frame_ms[PROFILER_HISTORY_SIZE];
+  double frame_start;
+  u64 frame;
+  bool show_overlay;
+  // the frame time being aimed for, frames over it are counted as missed
+  float budget_ms;
+  // shown above the stats, e.g. how the frames are paced
+  char title[64];
+} Profiler;
+
+typedef struct ProfilerStats {
+  float min;
+  float avg;
+  float p99;
+  float max;
+  // how much the samples jitter
+  float stddev;
+  int samples_count;
+} ProfilerStats;
+
+void profiler_init(Profiler *profiler, const char **phase_names, int phases_count);
+void profiler_deinit(Profiler *profiler);
+// drops the history, for when the stats of a new configuration are wanted
+void profiler_reset(Profiler *profiler);
+void profiler_begin(Profiler *profiler, int phase);
+void profiler_end(Profiler *profiler, int phase);
+// MUST be called once per frame after the buffers are swapped
+void profiler_end_frame(Profiler *profiler);
+ProfilerStats profiler_stats(const float *samples);
+void profiler_draw_overlay(Profiler *profiler);
+void profiler_print_report(Profiler *profiler);
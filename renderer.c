@@ -0,0 +1,337 @@
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glx.h>
+
+#include "gl_stats.h"
+#include "renderer.h"
+#include "zephr.h"
+
+#define RENDERER_INITIAL_COMMANDS_CAPACITY 256
+
+#define RENDER_KEY_LAYER_SHIFT 56
+#define RENDER_KEY_PIPELINE_SHIFT 48
+#define RENDER_KEY_TEXTURE_SHIFT 32
+#define RENDER_KEY_TEXTURE_MASK 0xffffull
+
+void renderer_init(Renderer *renderer) {
+  CORE_ZERO_ELMT(renderer);
+  renderer->commands_capacity = RENDERER_INITIAL_COMMANDS_CAPACITY;
+  renderer->commands = malloc(renderer->commands_capacity * sizeof(RenderCommand));
+  CORE_ASSERT(renderer->commands, "failed to allocate the render commands");
+}
+
+void renderer_deinit(Renderer *renderer) {
+  free(renderer->commands);
+  free(renderer->damage.tile_hashes);
+  free(renderer->damage.last_tile_hashes);
+  CORE_ZERO_ELMT(renderer);
+}
+
+void renderer_set_layer(Renderer *renderer, u8 layer) {
+  renderer->layer = layer;
+}
+
+RenderCommand *push_command(Renderer *renderer, RenderPipeline pipeline, unsigned int texture) {
+  if (renderer->commands_count == renderer->commands_capacity) {
+    renderer->commands_capacity *= 2;
+    renderer->commands = realloc(renderer->commands, renderer->commands_capacity * sizeof(RenderCommand));
+    CORE_ASSERT(renderer->commands, "failed to grow the render commands to %d", renderer->commands_capacity);
+  }
+
+  RenderCommand *command = &renderer->commands[renderer->commands_count++];
+  command->pipeline = pipeline;
+  command->key = (u64)renderer->layer << RENDER_KEY_LAYER_SHIFT |
+    (u64)pipeline << RENDER_KEY_PIPELINE_SHIFT |
+    ((u64)texture & RENDER_KEY_TEXTURE_MASK) << RENDER_KEY_TEXTURE_SHIFT |
+    renderer->sequence++;
+
+  return command;
+}
+
+void renderer_begin_frame(Renderer *renderer, int buffer_age) {
+  renderer->buffer_age = buffer_age;
+  renderer->is_frame_pending = true;
+}
+
+void renderer_push_shape(Renderer *renderer, const ShapeInstance *shape) {
+  RenderCommand *command = push_command(renderer, RENDER_PIPELINE_SHAPES, 0);
+  command->shape = *shape;
+}
+
+void renderer_push_glyphs(Renderer *renderer, const GlyphInstance *instances, int instances_count, float outline_width, const Color *outline_color) {
+  if (instances_count == 0) return;
+
+  RenderCommand *command = push_command(renderer, RENDER_PIPELINE_GLYPHS, zephr_ctx.font.atlas_texture_id);
+  command->glyphs.instances = instances;
+  command->glyphs.instances_count = instances_count;
+  command->glyphs.outline_width = outline_width;
+  command->glyphs.outline_color = *outline_color;
+}
+
+int compare_commands(const void *a, const void *b) {
+  u64 key_a = ((const RenderCommand *)a)->key;
+  u64 key_b = ((const RenderCommand *)b)->key;
+  return (key_a > key_b) - (key_a < key_b);
+}
+
+// whether the glyphs of both commands can go in the same draw call
+bool can_merge_glyphs(const RenderCommand *a, const RenderCommand *b) {
+  return b->pipeline == RENDER_PIPELINE_GLYPHS &&
+    (a->key >> RENDER_KEY_TEXTURE_SHIFT & RENDER_KEY_TEXTURE_MASK) == (b->key >> RENDER_KEY_TEXTURE_SHIFT & RENDER_KEY_TEXTURE_MASK) &&
+    a->glyphs.outline_width == b->glyphs.outline_width &&
+    memcmp(&a->glyphs.outline_color, &b->glyphs.outline_color, sizeof(Color)) == 0;
+}
+
+bool is_rect_empty(RenderRect rect) {
+  return rect.width <= 0 || rect.height <= 0;
+}
+
+RenderRect rect_union(RenderRect a, RenderRect b) {
+  if (is_rect_empty(a)) return b;
+  if (is_rect_empty(b)) return a;
+
+  int x0 = CORE_MIN(a.x, b.x);
+  int y0 = CORE_MIN(a.y, b.y);
+  int x1 = CORE_MAX(a.x + a.width, b.x + b.width);
+  int y1 = CORE_MAX(a.y + a.height, b.y + b.height);
+  return (RenderRect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+RenderRect rect_clamp(RenderRect rect, Size size) {
+  int x0 = CORE_MAX(rect.x, 0);
+  int y0 = CORE_MAX(rect.y, 0);
+  int x1 = CORE_MIN(rect.x + rect.width, size.width);
+  int y1 = CORE_MIN(rect.y + rect.height, size.height);
+  return (RenderRect){ x0, y0, CORE_MAX(x1 - x0, 0), CORE_MAX(y1 - y0, 0) };
+}
+
+// the pixels a command can touch, anti-aliased edges included
+RenderRect command_bounds(const RenderCommand *command) {
+  float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+
+  if (command->pipeline == RENDER_PIPELINE_SHAPES) {
+    Vec4f rect = command->shape.rect;
+    x0 = rect.x;
+    y0 = rect.y;
+    x1 = rect.x + rect.z;
+    y1 = rect.y + rect.w;
+
+    if (command->shape.rotation != 0.f) {
+      // whatever the rotation the shape stays within the circle around it
+      Vec2f center = { (x0 + x1) / 2.f, (y0 + y1) / 2.f };
+      float radius = sqrtf(rect.z * rect.z + rect.w * rect.w) / 2.f;
+      x0 = center.x - radius;
+      y0 = center.y - radius;
+      x1 = center.x + radius;
+      y1 = center.y + radius;
+    }
+  } else {
+    for (int i = 0; i < command->glyphs.instances_count; i++) {
+      const GlyphInstance *instance = &command->glyphs.instances[i];
+      // the corners of the glyph quad through the model matrix, as the vertex
+      // shader does it
+      for (int corner = 0; corner < 4; corner++) {
+        float x = instance->position.x + (corner & 1) * instance->position.z;
+        float y = instance->position.y + (corner >> 1) * instance->position.w;
+        float tx = instance->model[0][0] * x + instance->model[1][0] * y + instance->model[3][0];
+        float ty = instance->model[0][1] * x + instance->model[1][1] * y + instance->model[3][1];
+        x0 = CORE_MIN(x0, tx);
+        y0 = CORE_MIN(y0, ty);
+        x1 = CORE_MAX(x1, tx);
+        y1 = CORE_MAX(y1, ty);
+      }
+    }
+  }
+
+  if (x0 > x1 || y0 > y1) return (RenderRect){0};
+
+  // a pixel of margin for the anti-aliasing
+  int left = (int)floorf(x0) - 1;
+  int top = (int)floorf(y0) - 1;
+  return (RenderRect){ left, top, (int)ceilf(x1) + 1 - left, (int)ceilf(y1) + 1 - top };
+}
+
+u64 command_hash(const RenderCommand *command) {
+  // the layer, pipeline and texture but not the sequence, which changes
+  // whenever something is drawn before the command
+  u64 key = command->key >> RENDER_KEY_TEXTURE_SHIFT;
+  u64 hash = core_hash_fnv1a_64(&key, sizeof(key), CORE_FNV1A_64_SEED);
+
+  if (command->pipeline == RENDER_PIPELINE_SHAPES) {
+    return core_hash_fnv1a_64(&command->shape, sizeof(ShapeInstance), hash);
+  }
+
+  hash = core_hash_fnv1a_64(&command->glyphs.outline_width, sizeof(float), hash);
+  hash = core_hash_fnv1a_64(&command->glyphs.outline_color, sizeof(Color), hash);
+  return core_hash_fnv1a_64(command->glyphs.instances, command->glyphs.instances_count * sizeof(GlyphInstance), hash);
+}
+
+void resize_damage(RenderDamage *damage, Size size) {
+  free(damage->tile_hashes);
+  free(damage->last_tile_hashes);
+
+  damage->size = size;
+  damage->columns = (size.width + RENDER_DAMAGE_TILE_SIZE - 1) / RENDER_DAMAGE_TILE_SIZE;
+  damage->rows = (size.height + RENDER_DAMAGE_TILE_SIZE - 1) / RENDER_DAMAGE_TILE_SIZE;
+  // the last hashes start at 0, which no tile hashes to, so the first frame
+  // is damaged everywhere
+  damage->tile_hashes = calloc(damage->columns * damage->rows, sizeof(u64));
+  damage->last_tile_hashes = calloc(damage->columns * damage->rows, sizeof(u64));
+  CORE_ASSERT(damage->tile_hashes && damage->last_tile_hashes, "failed to allocate the damage tiles for %dx%d", size.width, size.height);
+  // the older frames were a different size
+  damage->history_count = 0;
+}
+
+// the part of the window to draw again this frame, from the commands sorted
+// in the order they're drawn
+RenderRect find_redraw_rect(Renderer *renderer) {
+  RenderDamage *damage = &renderer->damage;
+  Size size = zephr_ctx.window.size;
+  if (size.width != damage->size.width || size.height != damage->size.height) {
+    resize_damage(damage, size);
+  }
+
+  int tiles_count = damage->columns * damage->rows;
+  for (int i = 0; i < tiles_count; i++) {
+    damage->tile_hashes[i] = CORE_FNV1A_64_SEED;
+  }
+
+  // chaining the hashes makes them depend on the order things are drawn in
+  // over each tile, not only on what's drawn
+  for (int i = 0; i < renderer->commands_count; i++) {
+    RenderRect bounds = rect_clamp(command_bounds(&renderer->commands[i]), size);
+    if (is_rect_empty(bounds)) continue;
+
+    u64 hash = command_hash(&renderer->commands[i]);
+    int column_end = (bounds.x + bounds.width - 1) / RENDER_DAMAGE_TILE_SIZE;
+    int row_end = (bounds.y + bounds.height - 1) / RENDER_DAMAGE_TILE_SIZE;
+    for (int row = bounds.y / RENDER_DAMAGE_TILE_SIZE; row <= row_end; row++) {
+      for (int column = bounds.x / RENDER_DAMAGE_TILE_SIZE; column <= column_end; column++) {
+        u64 *tile = &damage->tile_hashes[row * damage->columns + column];
+        *tile = core_hash_fnv1a_64(&hash, sizeof(hash), *tile);
+      }
+    }
+  }
+
+  RenderRect changed = {0};
+  for (int row = 0; row < damage->rows; row++) {
+    for (int column = 0; column < damage->columns; column++) {
+      int tile = row * damage->columns + column;
+      if (damage->tile_hashes[tile] != damage->last_tile_hashes[tile]) {
+        RenderRect tile_rect = {
+          column * RENDER_DAMAGE_TILE_SIZE,
+          row * RENDER_DAMAGE_TILE_SIZE,
+          RENDER_DAMAGE_TILE_SIZE,
+          RENDER_DAMAGE_TILE_SIZE,
+        };
+        changed = rect_union(changed, tile_rect);
+      }
+    }
+  }
+  changed = rect_clamp(changed, size);
+
+  u64 *last_tile_hashes = damage->last_tile_hashes;
+  damage->last_tile_hashes = damage->tile_hashes;
+  damage->tile_hashes = last_tile_hashes;
+
+  memmove(&damage->history[1], &damage->history[0], (RENDER_DAMAGE_HISTORY - 1) * sizeof(RenderRect));
+  damage->history[0] = changed;
+  damage->history_count = CORE_MIN(damage->history_count + 1, RENDER_DAMAGE_HISTORY);
+
+  // the buffer is missing the changes of every frame since it was drawn
+  int age = renderer->buffer_age;
+  if (age <= 0 || age > damage->history_count) {
+    return (RenderRect){ 0, 0, size.width, size.height };
+  }
+
+  RenderRect redraw = {0};
+  for (int i = 0; i < age; i++) {
+    redraw = rect_union(redraw, damage->history[i]);
+  }
+
+  return redraw;
+}
+
+void renderer_flush(Renderer *renderer) {
+  RendererStats stats = { .commands_count = renderer->commands_count };
+
+  // the sequence in the low bits makes every key unique, so the unstable
+  // sort still keeps the order the commands were recorded in
+  qsort(renderer->commands, renderer->commands_count, sizeof(RenderCommand), compare_commands);
+
+  if (renderer->is_frame_pending) {
+    renderer->is_frame_pending = false;
+    renderer->redraw = find_redraw_rect(renderer);
+
+    // the rest of the buffer is left as it was, the scissor applies to the
+    // clear and to every draw until the end of the frame
+    RenderRect redraw = renderer->redraw;
+    glEnable(GL_SCISSOR_TEST);
+    // gl counts from the bottom
+    glScissor(redraw.x, zephr_ctx.window.size.height - redraw.y - redraw.height, redraw.width, redraw.height);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+
+  Size size = zephr_ctx.window.size;
+  if (size.width > 0 && size.height > 0) {
+    stats.redrawn_fraction = (float)renderer->redraw.width * renderer->redraw.height / ((float)size.width * size.height);
+  }
+
+  int last_pipeline = -1;
+  // nothing would make it through the scissor
+  int i = is_rect_empty(renderer->redraw) ? renderer->commands_count : 0;
+  while (i < renderer->commands_count) {
+    RenderCommand *first = &renderer->commands[i];
+
+    // commands only end up next to each other after sorting when nothing
+    // else has to be drawn between them, so merging them is always safe
+    int j = i + 1;
+    if (first->pipeline == RENDER_PIPELINE_SHAPES) {
+      while (j < renderer->commands_count && renderer->commands[j].pipeline == RENDER_PIPELINE_SHAPES) j++;
+
+      int instances_count = j - i;
+      ShapeInstance *instances = core_arena_alloc(&zephr_ctx.frame_arena, instances_count * sizeof(ShapeInstance), _Alignof(ShapeInstance));
+      for (int k = 0; k < instances_count; k++) {
+        instances[k] = renderer->commands[i + k].shape;
+      }
+
+      draw_shape_instances(instances, instances_count);
+    } else {
+      int instances_count = first->glyphs.instances_count;
+      while (j < renderer->commands_count && can_merge_glyphs(first, &renderer->commands[j])) {
+        instances_count += renderer->commands[j].glyphs.instances_count;
+        j++;
+      }
+
+      GlyphInstance *instances = core_arena_alloc(&zephr_ctx.frame_arena, instances_count * sizeof(GlyphInstance), _Alignof(GlyphInstance));
+      GlyphInstance *cursor = instances;
+      for (int k = i; k < j; k++) {
+        memcpy(cursor, renderer->commands[k].glyphs.instances, renderer->commands[k].glyphs.instances_count * sizeof(GlyphInstance));
+        cursor += renderer->commands[k].glyphs.instances_count;
+      }
+
+      draw_glyph_instances(instances, instances_count, first->glyphs.outline_width, &first->glyphs.outline_color);
+    }
+
+    if ((int)first->pipeline != last_pipeline) {
+      stats.program_switches_count++;
+      last_pipeline = first->pipeline;
+    }
+    stats.draw_calls_count++;
+    i = j;
+  }
+
+  renderer->stats = stats;
+  renderer->commands_count = 0;
+  renderer->sequence = 0;
+  renderer->layer = 0;
+}
+
+void renderer_end_frame(Renderer *renderer) {
+  renderer->is_frame_pending = false;
+  glDisable(GL_SCISSOR_TEST);
+}
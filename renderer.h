@@ -0,0 +1,105 @@
+#pragma once
+
+#include "core.h"
+#include "text.h"
+#include "ui.h"
+
+// the layer drawn above everything else, e.g. for debug overlays
+#define RENDER_LAYER_TOP 255
+// the size in pixels of the tiles the damage is tracked in
+#define RENDER_DAMAGE_TILE_SIZE 32
+// how many frames of damage are kept, back buffers older than that are
+// redrawn entirely
+#define RENDER_DAMAGE_HISTORY 4
+
+// the order of these is the order they're drawn in within a layer, so text
+// always ends up above the shapes of the same layer
+typedef enum RenderPipeline {
+  RENDER_PIPELINE_SHAPES,
+  RENDER_PIPELINE_GLYPHS,
+} RenderPipeline;
+
+typedef struct RenderCommand {
+  // layer, pipeline, texture and sequence packed from the most significant
+  // bits down. sorting by it groups commands that can be batched together
+  // while keeping the layers and the order of draws within them intact
+  u64 key;
+  RenderPipeline pipeline;
+  union {
+    ShapeInstance shape;
+    struct {
+      // allocated from the frame arena by the caller
+      const GlyphInstance *instances;
+      int instances_count;
+      float outline_width;
+      Color outline_color;
+    } glyphs;
+  };
+} RenderCommand;
+
+// in pixels from the top left of the window
+typedef struct RenderRect {
+  int x;
+  int y;
+  int width;
+  int height;
+} RenderRect;
+
+typedef struct RendererStats {
+  int commands_count;
+  int draw_calls_count;
+  int program_switches_count;
+  // the part of the window that was redrawn, from 0 to 1
+  float redrawn_fraction;
+} RendererStats;
+
+// finds what changed on screen since the last frame without the game having
+// to say. everything drawn is hashed into the tiles it covers, so the tiles
+// whose hash differs from the last frame's are the ones that look different
+typedef struct RenderDamage {
+  Size size;
+  int columns;
+  int rows;
+  u64 *tile_hashes;
+  u64 *last_tile_hashes;
+  // the damage of the last frames, the latest first
+  RenderRect history[RENDER_DAMAGE_HISTORY];
+  int history_count;
+} RenderDamage;
+
+// draws are recorded as commands during the frame, then sorted and flushed
+// at once with adjacent compatible commands merged into instanced draws
+typedef struct Renderer {
+  RenderCommand *commands;
+  int commands_count;
+  int commands_capacity;
+  u32 sequence;
+  u8 layer;
+  RenderDamage damage;
+  // how many frames old the contents of the buffer being drawn to are, 0 when
+  // they're unknown. set at the start of every frame
+  int buffer_age;
+  // whether the frame hasn't been flushed yet, the first flush clears it
+  bool is_frame_pending;
+  // the part of the window drawn this frame
+  RenderRect redraw;
+  // the stats of the last flushed frame
+  RendererStats stats;
+} Renderer;
+
+void renderer_init(Renderer *renderer);
+void renderer_deinit(Renderer *renderer);
+// the layer of every following command. commands of a higher layer are drawn
+// on top, whatever order they were recorded in
+void renderer_set_layer(Renderer *renderer, u8 layer);
+// starts a frame drawn into a buffer holding the frame from buffer_age frames
+// ago, so only what changed since then has to be drawn again
+void renderer_begin_frame(Renderer *renderer, int buffer_age);
+void renderer_push_shape(Renderer *renderer, const ShapeInstance *shape);
+void renderer_push_glyphs(Renderer *renderer, const GlyphInstance *instances, int instances_count, float outline_width, const Color *outline_color);
+// draws and clears the recorded commands. the first flush of a frame finds
+// the damage and clears it, the draws of the whole frame are then clipped to
+// it. so everything has to be recorded before the first flush for the
+// changes to be drawn
+void renderer_flush(Renderer *renderer);
+void renderer_end_frame(Renderer *renderer);
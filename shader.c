@@ -1,11 +1,26 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <glad/gl.h>
 
 #include "core.h"
+#include "gl_stats.h"
 #include "shader.h"
 
+// linked programs are cached in $XDG_CACHE_HOME/zephr/shaders/<hash>.bin where
+// the hash covers the driver and both sources. the file is the header followed
+// by the program binary
+#define PROGRAM_CACHE_MAGIC 0x5053465a // "ZFSP"
+
+typedef struct ProgramCacheHeader {
+  u32 magic;
+  u32 binary_format;
+  u32 binary_length;
+} ProgramCacheHeader;
+
 void read_shader_file(const char *path, char **buf) {
   FILE *fp = fopen(path, "rb");
 
@@ -28,48 +43,181 @@ void read_shader_file(const char *path, char **buf) {
   fclose(fp);
 }
 
-Shader create_shader(const char *vertex_path, const char *fragment_path) {
-  Shader shader;
+// returns the source of the shader that was embedded at build time. if it
+// wasn't embedded it's read from the path instead and *allocated is set so the
+// caller frees it
+const char *get_shader_source(const char *path, int *length_out, bool *allocated) {
+  for (int i = 0; i < embedded_shaders_count; i++) {
+    if (strcmp(embedded_shaders[i].path, path) == 0) {
+      *length_out = (int)embedded_shaders[i].length;
+      *allocated = false;
+      return (const char *)embedded_shaders[i].source;
+    }
+  }
+
+  char *source = NULL;
+  read_shader_file(path, &source);
+  *length_out = (int)strlen(source);
+  *allocated = true;
+  return source;
+}
+
+bool program_binaries_supported(void) {
+  if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary) return false;
+
+  int formats_count = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats_count);
+  return formats_count > 0;
+}
+
+// binaries are only valid for the driver that produced them, so the driver
+// strings are part of the key
+bool get_program_cache_path(const char *v_source, int v_length, const char *f_source, int f_length, char *path_out, int path_size) {
+  char dir[PATH_MAX];
+  if (!core_cache_dir("zephr/shaders", dir, sizeof(dir))) return false;
 
-  char *v_shader_source = NULL;
-  char *f_shader_source = NULL;
-  read_shader_file(vertex_path, &v_shader_source);
-  read_shader_file(fragment_path, &f_shader_source);
-
-  int v_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(v_shader, 1, (const char **)&v_shader_source, NULL);
-  glCompileShader(v_shader);
-  int success0 = 0;
-  glGetShaderiv(v_shader, GL_COMPILE_STATUS, &success0);
-  printf("vertex shader %s compiled with status: %d\n", vertex_path, success0);
-  if (!success0) {
-    char info_buf[512];
-    glGetShaderInfoLog(v_shader, 512, NULL, info_buf);
-    printf("vertex shader info: %s\n", info_buf);
+  const char *vendor = (const char *)glGetString(GL_VENDOR);
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  const char *version = (const char *)glGetString(GL_VERSION);
+
+  u64 hash = CORE_FNV1A_64_SEED;
+  hash = core_hash_fnv1a_64(vendor, strlen(vendor) + 1, hash);
+  hash = core_hash_fnv1a_64(renderer, strlen(renderer) + 1, hash);
+  hash = core_hash_fnv1a_64(version, strlen(version) + 1, hash);
+  hash = core_hash_fnv1a_64(v_source, v_length, hash);
+  hash = core_hash_fnv1a_64(f_source, f_length, hash);
+
+  snprintf(path_out, path_size, "%s/%016llx.bin", dir, (unsigned long long)hash);
+
+  return true;
+}
+
+// returns the program loaded from the cached binary, or 0 if there's no cached
+// binary or the driver rejects it
+int load_program_binary(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return 0;
+
+  ProgramCacheHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != PROGRAM_CACHE_MAGIC) {
+    fclose(file);
+    return 0;
   }
 
-  int f_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(f_shader, 1, (const char **)&f_shader_source, NULL);
-  glCompileShader(f_shader);
-  int success1 = 0;
-  glGetShaderiv(f_shader, GL_COMPILE_STATUS, &success1);
-  printf("frag shader %s compiled with status: %d\n", fragment_path, success1);
-  if (!success1) {
-    char info_buf[512];
-    glGetShaderInfoLog(f_shader, 512, NULL, info_buf);
-    printf("frag shader info: %s\n", info_buf);
+  void *binary = malloc(header.binary_length);
+  if (!binary || fread(binary, header.binary_length, 1, file) != 1) {
+    free(binary);
+    fclose(file);
+    return 0;
   }
+  fclose(file);
 
   int program = glCreateProgram();
-  glAttachShader(program, v_shader);
-  glAttachShader(program, f_shader);
-  glLinkProgram(program);
+  glProgramBinary(program, header.binary_format, binary, header.binary_length);
+  free(binary);
+
+  int success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    printf("[WARN] Cached shader program \"%s\" was rejected by the driver\n", path);
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
+
+void save_program_binary(int program, const char *path) {
+  int length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
 
-  glDeleteShader(v_shader);
-  glDeleteShader(f_shader);
+  void *binary = malloc(length);
+  if (!binary) return;
 
-  free(v_shader_source);
-  free(f_shader_source);
+  ProgramCacheHeader header = { .magic = PROGRAM_CACHE_MAGIC };
+  glGetProgramBinary(program, length, NULL, &header.binary_format, binary);
+  header.binary_length = (u32)length;
+
+  char tmp_path[PATH_MAX];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+  FILE *file = fopen(tmp_path, "wb");
+  bool ok = file &&
+    fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(binary, length, 1, file) == 1;
+  if (file && fclose(file) != 0) ok = false;
+
+  if (!ok || rename(tmp_path, path) != 0) {
+    printf("[WARN] Failed to write shader program cache \"%s\"\n", path);
+    remove(tmp_path);
+  }
+
+  free(binary);
+}
+
+Shader create_shader(const char *vertex_path, const char *fragment_path) {
+  Shader shader;
+
+  int v_length = 0;
+  int f_length = 0;
+  bool v_allocated = false;
+  bool f_allocated = false;
+  const char *v_shader_source = get_shader_source(vertex_path, &v_length, &v_allocated);
+  const char *f_shader_source = get_shader_source(fragment_path, &f_length, &f_allocated);
+
+  char cache_path[PATH_MAX];
+  bool use_cache = program_binaries_supported() &&
+    get_program_cache_path(v_shader_source, v_length, f_shader_source, f_length, cache_path, sizeof(cache_path));
+
+  int program = use_cache ? load_program_binary(cache_path) : 0;
+  if (program) {
+    printf("shader program %s %s loaded from cache\n", vertex_path, fragment_path);
+  } else {
+    int v_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(v_shader, 1, &v_shader_source, &v_length);
+    glCompileShader(v_shader);
+    int success0 = 0;
+    glGetShaderiv(v_shader, GL_COMPILE_STATUS, &success0);
+    printf("vertex shader %s compiled with status: %d\n", vertex_path, success0);
+    if (!success0) {
+      char info_buf[512];
+      glGetShaderInfoLog(v_shader, 512, NULL, info_buf);
+      printf("vertex shader info: %s\n", info_buf);
+    }
+
+    int f_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(f_shader, 1, &f_shader_source, &f_length);
+    glCompileShader(f_shader);
+    int success1 = 0;
+    glGetShaderiv(f_shader, GL_COMPILE_STATUS, &success1);
+    printf("frag shader %s compiled with status: %d\n", fragment_path, success1);
+    if (!success1) {
+      char info_buf[512];
+      glGetShaderInfoLog(f_shader, 512, NULL, info_buf);
+      printf("frag shader info: %s\n", info_buf);
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, v_shader);
+    glAttachShader(program, f_shader);
+    if (use_cache) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+
+    glDeleteShader(v_shader);
+    glDeleteShader(f_shader);
+
+    int linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (use_cache && linked) {
+      save_program_binary(program, cache_path);
+    }
+  }
+
+  if (v_allocated) free((char *)v_shader_source);
+  if (f_allocated) free((char *)f_shader_source);
 
   shader.program = program;
 
@@ -85,6 +233,11 @@ void set_mat4f(Shader shader, const char *name, float *mat4) {
   glUniformMatrix4fv(loc, 1, GL_FALSE, mat4);
 }
 
+void set_int(Shader shader, const char *name, int val) {
+  int loc = glGetUniformLocation(shader.program, name);
+  glUniform1i(loc, val);
+}
+
 void set_float(Shader shader, const char *name, float val) {
   int loc = glGetUniformLocation(shader.program, name);
   glUniform1f(loc, val);
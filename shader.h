@@ -4,10 +4,24 @@ typedef struct Shader {
   int program;
 } Shader;
 
+// shader sources compiled into the binary. the table is generated from
+// shaders/ by the Makefile into embedded_shaders.c
+typedef struct EmbeddedShader {
+  const char *path;
+  const unsigned char *source;
+  unsigned int length;
+} EmbeddedShader;
+
+extern const EmbeddedShader embedded_shaders[];
+extern const int embedded_shaders_count;
+
 void read_shader_file(const char *path, char **buf);
+// the paths are looked up in the embedded shaders first and only read from
+// disk if they aren't there
 Shader create_shader(const char *vertex_path, const char *fragment_path);
 void use_shader(Shader shader);
 void set_mat4f(Shader shader, const char *name, float *mat);
+void set_int(Shader shader, const char *name, int val);
 void set_float(Shader shader, const char *name, float val);
 void set_vec2f(Shader shader, const char *name, float val1, float val2);
 void set_vec3f(Shader shader, const char *name, float val1, float val2, float val3);
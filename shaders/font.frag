@@ -4,18 +4,31 @@ in vec4 textColor;
 out vec4 FragColor;
 
 uniform sampler2D text;
-
-const float smoothness = 0.05;
-const float outlineDistance = 0.50;
-const vec4 outlineColor = vec4(0.0, 0.0, 0.0, 1.0);
+// the atlas holds signed distance fields instead of coverage
+uniform bool sdf;
+// in distance field units, 0 disables the outline
+uniform float outlineWidth;
+uniform vec4 outlineColor;
 
 void main() {
-  //float distance = texture(text, v_TexCoords).r;
-  //float outlineFactor = smoothstep(0.5 - smoothness, 0.5 + smoothness, distance);
-  //vec4 color = mix(outlineColor, textColor, outlineFactor);
-  //float alpha = smoothstep(outlineDistance - smoothness, outlineDistance + smoothness, distance);
+  if (!sdf) {
+    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, v_TexCoords).r);
+    FragColor = textColor * sampled;
+    return;
+  }
+
+  // 0.5 is the edge of the glyph. smooth over about a screen pixel so the edge
+  // stays crisp no matter how much the glyph is scaled
+  float distance = texture(text, v_TexCoords).r;
+  float smoothness = max(length(vec2(dFdx(distance), dFdy(distance))) * 0.7, 0.001);
+  float alpha = smoothstep(0.5 - smoothness, 0.5 + smoothness, distance);
 
-  vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, v_TexCoords).r);
-  FragColor = textColor * sampled;
-  //FragColor = vec4(color.rgb, textColor.a * alpha);
+  if (outlineWidth > 0.0) {
+    float outlineEdge = 0.5 - outlineWidth;
+    float outlineAlpha = smoothstep(outlineEdge - smoothness, outlineEdge + smoothness, distance);
+    vec4 color = mix(outlineColor, textColor, alpha);
+    FragColor = vec4(color.rgb, color.a * outlineAlpha);
+  } else {
+    FragColor = vec4(textColor.rgb, textColor.a * alpha);
+  }
 }
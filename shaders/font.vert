@@ -10,12 +10,16 @@ layout (location = 4) in mat4 model; // this takes locations 4,5,6,7
 out vec2 v_TexCoords;
 out vec4 textColor;
 uniform mat4 projection;
-// buffer for all the 96 ascii characters' texcoords
-uniform vec2 texcoords[96 * 4];
+// one (x0, y0, x1, y1) atlas rect in pixels per glyph, indexed by tex_index
+uniform samplerBuffer glyph_rects;
+uniform sampler2D text;
 
 void main() {
   vec2 pos = vec2((vertex.x) * offset.z, (vertex.y) * offset.w);
   gl_Position = projection * model * vec4(pos + offset.xy, 0.0, 1.0);
-  v_TexCoords = texcoords[tex_index * 4 + gl_VertexID];
+  vec4 rect = texelFetch(glyph_rects, tex_index);
+  // the quad vertices are already in [0, 1] so they pick the corner of the rect
+  // the rects are in pixels so they stay valid when the atlas grows
+  v_TexCoords = mix(rect.xy, rect.zw, vertex) / vec2(textureSize(text, 0));
   textColor = color;
 }
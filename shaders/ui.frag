@@ -1,33 +1,52 @@
 #version 330 core
 
-in vec2 v_TexCoords;
+in vec2 v_Position;
+in vec2 v_HalfSize;
+in vec4 v_Color;
+in float v_BorderRadius;
+in float v_BorderWidth;
+flat in int v_Shape;
 out vec4 FragColor;
+// whether the edges are smoothed, otherwise every pixel is either in or out
+uniform bool antiAliased;
 
-uniform vec4 aColor;
-uniform float borderRadius;
-uniform float uiWidth;
-uniform float uiHeight;
+// same as ShapeType
+const int SHAPE_CIRCLE = 1;
+const int SHAPE_TRIANGLE = 2;
 
-const float smoothness = 1.0;
+// b is the half size, r the corner radius
+float sdRoundedBox(vec2 p, vec2 b, float r) {
+  vec2 q = abs(p) - b + r;
+  return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;
+}
+
+// the tip at the origin and the base at q.y, q.x is half the base width
+float sdIsoscelesTriangle(vec2 p, vec2 q) {
+  p.x = abs(p.x);
+  vec2 a = p - q * clamp(dot(p, q) / dot(q, q), 0.0, 1.0);
+  vec2 b = p - q * vec2(clamp(p.x / q.x, 0.0, 1.0), 1.0);
+  float s = -sign(q.y);
+  vec2 d = min(vec2(dot(a, a), s * (p.x * q.y - p.y * q.x)), vec2(dot(b, b), s * (p.y - q.y)));
+  return -sqrt(d.x) * sign(d.y);
+}
 
 void main() {
-  float alpha = aColor.a;
-
-  if (borderRadius > 0.0) {
-    vec2 dimensions = v_TexCoords * vec2(uiWidth, uiHeight);
-    float xMax = uiWidth - borderRadius;
-    float yMax = uiHeight - borderRadius;
-
-    if (dimensions.x < borderRadius && dimensions.y < borderRadius) {
-      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(borderRadius)));
-    } else if (dimensions.x < borderRadius && dimensions.y > yMax) {
-      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(borderRadius, yMax)));
-    } else if (dimensions.x > xMax && dimensions.y < borderRadius) {
-      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(xMax, borderRadius)));
-    } else if (dimensions.x > xMax && dimensions.y > yMax) {
-      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(xMax, yMax)));
-    }
+  float distance;
+  if (v_Shape == SHAPE_TRIANGLE) {
+    // the base is along the top edge and the tip at the bottom center
+    distance = sdIsoscelesTriangle(vec2(v_Position.x, v_HalfSize.y - v_Position.y), vec2(v_HalfSize.x, v_HalfSize.y * 2.0));
+  } else {
+    float radius = v_Shape == SHAPE_CIRCLE ? min(v_HalfSize.x, v_HalfSize.y) : v_BorderRadius;
+    distance = sdRoundedBox(v_Position, v_HalfSize, min(radius, min(v_HalfSize.x, v_HalfSize.y)));
   }
 
-  FragColor = vec4(aColor.rgb, alpha);
+  // keeps the band of the given width on the inside of the edge
+  float half_border = v_BorderWidth * 0.5;
+  distance = mix(distance, abs(distance + half_border) - half_border, step(0.0001, v_BorderWidth));
+
+  // the distance is in pixels, so this covers about one pixel of anti-aliasing
+  float coverage = antiAliased ? clamp(0.5 - distance / max(fwidth(distance), 0.0001), 0.0, 1.0) : step(distance, 0.0);
+  float alpha = v_Color.a * coverage;
+
+  FragColor = vec4(v_Color.rgb, alpha);
 }
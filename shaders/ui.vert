@@ -1,11 +1,38 @@
 #version 330 core
-layout (location = 0) in vec4 vertex;
+layout (location = 0) in vec2 vertex;
+layout (location = 1) in vec4 rect;
+layout (location = 2) in vec4 color;
+// rotation, border radius, border width
+layout (location = 3) in vec3 params;
+layout (location = 4) in int shape;
+
+// the position relative to the center of the shape in pixels, which goes
+// past the half size by the padding
+out vec2 v_Position;
+out vec2 v_HalfSize;
+out vec4 v_Color;
+out float v_BorderRadius;
+out float v_BorderWidth;
+flat out int v_Shape;
 
-out vec2 v_TexCoords;
 uniform mat4 projection;
-uniform mat4 model;
+
+// the quad reaches this far past the rect in pixels, so the outer half of the
+// anti-aliased edge isn't cut off by the geometry
+const float EDGE_PADDING = 1.0;
 
 void main() {
-  gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
-  v_TexCoords = vertex.zw;
+  // rotate around the center of the rect
+  vec2 center = rect.zw / 2.0;
+  vec2 p = vertex * (rect.zw + 2.0 * EDGE_PADDING) - center - EDGE_PADDING;
+  float s = sin(params.x);
+  float c = cos(params.x);
+
+  gl_Position = projection * vec4(vec2(c * p.x - s * p.y, s * p.x + c * p.y) + center + rect.xy, 0.0, 1.0);
+  v_Position = p;
+  v_HalfSize = center;
+  v_Color = color;
+  v_BorderRadius = params.y;
+  v_BorderWidth = params.z;
+  v_Shape = shape;
 }
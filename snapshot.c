@@ -0,0 +1,78 @@
+#include <stdlib.h>
+
+#include "snapshot.h"
+
+// a producer slot, a consumer slot and the one being handed over
+#define SNAPSHOT_SLOTS_COUNT 3
+#define SNAPSHOT_FRESH 0x80000000u
+#define SNAPSHOT_SLOT_MASK 0x3u
+
+// every slot starts with the sequence of the snapshot it holds, followed by
+// the snapshot itself
+typedef struct SnapshotHeader {
+  u64 sequence;
+  u64 _pad;
+} SnapshotHeader;
+
+u8 *snapshot_buffer_slot_at(SnapshotBuffer *buffer, u32 slot) {
+  return buffer->slots + (uptr)slot * (sizeof(SnapshotHeader) + buffer->slot_size);
+}
+
+void snapshot_buffer_init(SnapshotBuffer *buffer, u32 slot_size) {
+  buffer->slot_size = CORE_INT_ROUND_UP_ALIGN(slot_size, 16);
+  buffer->slots = calloc(SNAPSHOT_SLOTS_COUNT, sizeof(SnapshotHeader) + buffer->slot_size);
+  CORE_ASSERT(buffer->slots, "failed to allocate the snapshot slots");
+
+  buffer->write_slot = 0;
+  buffer->read_slot = 1;
+  buffer->write_sequence = 0;
+  atomic_init(&buffer->shared_slot, 2);
+  atomic_init(&buffer->read_sequence, 0);
+}
+
+void snapshot_buffer_deinit(SnapshotBuffer *buffer) {
+  free(buffer->slots);
+  buffer->slots = NULL;
+}
+
+void *snapshot_buffer_write_slot(SnapshotBuffer *buffer) {
+  return snapshot_buffer_slot_at(buffer, buffer->write_slot) + sizeof(SnapshotHeader);
+}
+
+u64 snapshot_buffer_publish(SnapshotBuffer *buffer) {
+  SnapshotHeader *header = (SnapshotHeader *)snapshot_buffer_slot_at(buffer, buffer->write_slot);
+  header->sequence = ++buffer->write_sequence;
+
+  // the release makes the snapshot visible to the consumer before the slot is,
+  // the acquire makes sure the consumer is done with the slot we get back
+  u32 previous = atomic_exchange_explicit(&buffer->shared_slot, buffer->write_slot | SNAPSHOT_FRESH, memory_order_acq_rel);
+  buffer->write_slot = previous & SNAPSHOT_SLOT_MASK;
+
+  return header->sequence;
+}
+
+const void *snapshot_buffer_read(SnapshotBuffer *buffer, bool *is_new) {
+  *is_new = false;
+  if (atomic_load_explicit(&buffer->shared_slot, memory_order_relaxed) & SNAPSHOT_FRESH) {
+    u32 previous = atomic_exchange_explicit(&buffer->shared_slot, buffer->read_slot, memory_order_acq_rel);
+    buffer->read_slot = previous & SNAPSHOT_SLOT_MASK;
+    *is_new = true;
+  }
+
+  SnapshotHeader *header = (SnapshotHeader *)snapshot_buffer_slot_at(buffer, buffer->read_slot);
+  if (header->sequence == 0) return NULL;
+
+  if (*is_new) {
+    atomic_store_explicit(&buffer->read_sequence, header->sequence, memory_order_release);
+  }
+
+  return snapshot_buffer_slot_at(buffer, buffer->read_slot) + sizeof(SnapshotHeader);
+}
+
+bool snapshot_buffer_has_new(SnapshotBuffer *buffer) {
+  return atomic_load_explicit(&buffer->shared_slot, memory_order_relaxed) & SNAPSHOT_FRESH;
+}
+
+u64 snapshot_buffer_read_sequence(SnapshotBuffer *buffer) {
+  return atomic_load_explicit(&buffer->read_sequence, memory_order_acquire);
+}
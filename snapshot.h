@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// hands immutable snapshots from one producer thread to one consumer thread
+// without locks. the producer writes into its own slot and publishes it by
+// swapping it with the shared slot, and the consumer takes the shared slot by
+// swapping it with the one it's done reading. so each side always owns a slot
+// the other can't touch, neither of them ever waits and the consumer always
+// gets the latest snapshot, skipping the ones it was too slow for
+typedef struct SnapshotBuffer {
+  u8 *slots;
+  u32 slot_size;
+  // only ever touched by the producer
+  u32 write_slot;
+  // only ever touched by the consumer
+  u32 read_slot;
+  // the slot in between, with SNAPSHOT_FRESH set while it holds a snapshot
+  // the consumer hasn't taken yet
+  atomic_uint shared_slot;
+  // the sequence of the last snapshot the consumer took, so the producer can
+  // tell what has been seen
+  atomic_ullong read_sequence;
+  u64 write_sequence;
+} SnapshotBuffer;
+
+void snapshot_buffer_init(SnapshotBuffer *buffer, u32 slot_size);
+void snapshot_buffer_deinit(SnapshotBuffer *buffer);
+// the slot to write the next snapshot into. it stays the producer's until the
+// snapshot is published
+void *snapshot_buffer_write_slot(SnapshotBuffer *buffer);
+// returns the sequence of the published snapshot, counting up from 1
+u64 snapshot_buffer_publish(SnapshotBuffer *buffer);
+// takes the latest published snapshot if there is a new one. returns NULL
+// until the first snapshot is published, otherwise the latest snapshot the
+// consumer took, which stays valid until the next call
+const void *snapshot_buffer_read(SnapshotBuffer *buffer, bool *is_new);
+// whether a snapshot the consumer hasn't taken yet was published, without
+// taking it
+bool snapshot_buffer_has_new(SnapshotBuffer *buffer);
+// the sequence of the latest snapshot the consumer took, 0 if none yet
+u64 snapshot_buffer_read_sequence(SnapshotBuffer *buffer);
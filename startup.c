@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "startup.h"
+
+StartupTrace startup_trace = {
+  .first_frame_ms = -1.0,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+// the trace thread of the calling thread, set by the tasks on their workers
+_Thread_local int startup_thread = 0;
+
+double startup_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void startup_trace_begin(void) {
+  startup_trace.origin_ms = startup_now_ms();
+  startup_trace.first_frame_ms = -1.0;
+  startup_trace.spans_count = 0;
+  startup_trace.thread_names[0] = "main";
+  startup_trace.threads_count = 1;
+}
+
+void startup_trace_push_span(const char *name, bool is_wait, double start_ms, double end_ms) {
+  pthread_mutex_lock(&startup_trace.mutex);
+  if (startup_trace.spans_count < STARTUP_MAX_SPANS) {
+    startup_trace.spans[startup_trace.spans_count++] = (StartupSpan){
+      .name = name,
+      .is_wait = is_wait,
+      .thread = startup_thread,
+      .start_ms = start_ms,
+      .end_ms = end_ms,
+    };
+  }
+  pthread_mutex_unlock(&startup_trace.mutex);
+}
+
+void startup_trace_span(const char *name, double start_ms) {
+  startup_trace_push_span(name, false, start_ms, startup_now_ms());
+}
+
+double startup_trace_end(void) {
+  pthread_mutex_lock(&startup_trace.mutex);
+  if (startup_trace.first_frame_ms < 0.0) {
+    startup_trace.first_frame_ms = startup_now_ms();
+  }
+  pthread_mutex_unlock(&startup_trace.mutex);
+
+  return startup_trace.first_frame_ms - startup_trace.origin_ms;
+}
+
+void startup_print_report(void) {
+  printf("[INFO] Startup:\n");
+  for (int i = 0; i < startup_trace.spans_count; i++) {
+    StartupSpan *span = &startup_trace.spans[i];
+    printf("  %-8s %-5s%-16s %8.2f ms at %8.2f ms\n", startup_trace.thread_names[span->thread],
+        span->is_wait ? "wait" : "", span->name, span->end_ms - span->start_ms, span->start_ms - startup_trace.origin_ms);
+  }
+  if (startup_trace.first_frame_ms >= 0.0) {
+    printf("  time to first frame: %.2f ms\n", startup_trace.first_frame_ms - startup_trace.origin_ms);
+  }
+}
+
+bool startup_trace_write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    printf("[WARN] Failed to open \"%s\" to write the startup trace\n", path);
+    return false;
+  }
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (int i = 0; i < startup_trace.threads_count; i++) {
+    fprintf(file, "  {\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+        i, startup_trace.thread_names[i]);
+  }
+  // the trace format counts in microseconds
+  for (int i = 0; i < startup_trace.spans_count; i++) {
+    StartupSpan *span = &startup_trace.spans[i];
+    fprintf(file, "  {\"name\":\"%s%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f},\n",
+        span->is_wait ? "wait " : "", span->name, span->thread,
+        (span->start_ms - startup_trace.origin_ms) * 1000.0, (span->end_ms - span->start_ms) * 1000.0);
+  }
+  if (startup_trace.first_frame_ms >= 0.0) {
+    fprintf(file, "  {\"name\":\"first frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.0f},\n",
+        (startup_trace.first_frame_ms - startup_trace.origin_ms) * 1000.0);
+  }
+  // the trailing comma of the last event isn't allowed in json
+  fprintf(file, "  {\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"startup\"}}\n]}\n");
+
+  return fclose(file) == 0;
+}
+
+void *startup_task_main(void *arg) {
+  StartupTask *task = arg;
+  startup_thread = task->thread;
+
+  double start_ms = startup_now_ms();
+  task->result = task->run(task->arg);
+  startup_trace_span(task->name, start_ms);
+
+  return NULL;
+}
+
+void startup_task_start(StartupTask *task) {
+  pthread_mutex_lock(&startup_trace.mutex);
+  bool has_thread = startup_trace.threads_count < STARTUP_MAX_THREADS;
+  if (has_thread) {
+    task->thread = startup_trace.threads_count++;
+    startup_trace.thread_names[task->thread] = task->name;
+  }
+  pthread_mutex_unlock(&startup_trace.mutex);
+
+  task->is_threaded = has_thread && pthread_create(&task->handle, NULL, startup_task_main, task) == 0;
+  if (!task->is_threaded) {
+    if (has_thread) {
+      printf("[WARN] Failed to start a thread for the \"%s\" startup task, running it in place\n", task->name);
+    }
+    // traced on the calling thread, which it held up all along
+    double start_ms = startup_now_ms();
+    task->result = task->run(task->arg);
+    startup_trace_push_span(task->name, false, start_ms, startup_now_ms());
+  }
+}
+
+int startup_task_wait(StartupTask *task) {
+  if (task->is_threaded) {
+    double start_ms = startup_now_ms();
+    pthread_join(task->handle, NULL);
+    task->is_threaded = false;
+
+    // only the waits that held the thread up are worth showing
+    double end_ms = startup_now_ms();
+    if (end_ms - start_ms >= 0.01) {
+      startup_trace_push_span(task->name, true, start_ms, end_ms);
+    }
+  }
+
+  return task->result;
+}
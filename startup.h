@@ -0,0 +1,69 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+#define STARTUP_MAX_SPANS 32
+#define STARTUP_MAX_THREADS 8
+
+// a timed part of the startup, on the thread it ran on
+typedef struct StartupSpan {
+  const char *name;
+  // waiting for a task is traced under the name of the task
+  bool is_wait;
+  // 0 is the thread that began the trace, the workers count up from 1
+  int thread;
+  double start_ms;
+  double end_ms;
+} StartupSpan;
+
+// the timeline of the startup up to the first frame. the times are in ms on
+// the startup_now_ms() clock
+typedef struct StartupTrace {
+  double origin_ms;
+  // -1 until the first frame was swapped
+  double first_frame_ms;
+  StartupSpan spans[STARTUP_MAX_SPANS];
+  int spans_count;
+  const char *thread_names[STARTUP_MAX_THREADS];
+  int threads_count;
+  pthread_mutex_t mutex;
+} StartupTrace;
+
+// a part of the startup that runs on a worker thread while the thread that
+// started it gets on with the rest. waiting for a task is what orders it
+// before the parts that need its results
+typedef struct StartupTask {
+  const char *name;
+  // returns 0 on success
+  int (*run)(void *arg);
+  void *arg;
+  int result;
+  int thread;
+  bool is_threaded;
+  pthread_t handle;
+} StartupTask;
+
+extern StartupTrace startup_trace;
+
+double startup_now_ms(void);
+// starts the timeline, as early in main() as possible
+void startup_trace_begin(void);
+// records a part of the startup that ran on the calling thread, which is
+// the one that began the trace unless it's a task
+void startup_trace_span(const char *name, double start_ms);
+// ends the timeline, called once the first frame was swapped. returns the
+// time to first frame
+double startup_trace_end(void);
+void startup_print_report(void);
+// writes the spans in the chrome trace event format, which chrome://tracing
+// and perfetto open
+bool startup_trace_write(const char *path);
+
+// runs the task on a new thread, or right away on the calling one if there
+// can't be another thread
+void startup_task_start(StartupTask *task);
+// blocks until the task is done and returns its result
+int startup_task_wait(StartupTask *task);
@@ -0,0 +1,112 @@
+#include <string.h>
+
+#include "gl_stats.h"
+#include "stream_buffer.h"
+
+bool stream_buffer_has_storage(void) {
+  return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+}
+
+void stream_buffer_create_storage(StreamBuffer *buffer) {
+  u32 size = buffer->frame_size * STREAM_BUFFER_FRAMES;
+
+  glGenBuffers(1, &buffer->id);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+
+  if (stream_buffer_has_storage()) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    buffer->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    CORE_ASSERT(buffer->mapped, "failed to persistently map stream buffer");
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    buffer->mapped = NULL;
+  }
+}
+
+void stream_buffer_destroy_storage(StreamBuffer *buffer) {
+  if (buffer->mapped) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    buffer->mapped = NULL;
+  }
+  glDeleteBuffers(1, &buffer->id);
+
+  for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+    if (buffer->fences[i]) {
+      glDeleteSync(buffer->fences[i]);
+      buffer->fences[i] = NULL;
+    }
+  }
+}
+
+void stream_buffer_init(StreamBuffer *buffer, u32 frame_size) {
+  CORE_ZERO_ELMT(buffer);
+  buffer->frame_size = frame_size;
+
+  stream_buffer_create_storage(buffer);
+}
+
+void stream_buffer_deinit(StreamBuffer *buffer) {
+  stream_buffer_destroy_storage(buffer);
+}
+
+// replaces the buffer with one that has slices of at least min_frame_size.
+// draws that were already submitted keep the old buffer alive until they're done
+void stream_buffer_grow(StreamBuffer *buffer, u32 min_frame_size) {
+  u32 frame_size = buffer->frame_size;
+  while (frame_size < min_frame_size) {
+    frame_size *= 2;
+  }
+
+  stream_buffer_destroy_storage(buffer);
+  buffer->frame_size = frame_size;
+  buffer->frame = 0;
+  buffer->offset = 0;
+  stream_buffer_create_storage(buffer);
+}
+
+u32 stream_buffer_push(StreamBuffer *buffer, const void *data, u32 size, u32 align) {
+  u32 offset = CORE_INT_ROUND_UP_ALIGN(buffer->offset, align);
+  if (offset + size > buffer->frame_size) {
+    stream_buffer_grow(buffer, offset + size);
+    offset = 0;
+  }
+  buffer->offset = offset + size;
+
+  u32 buffer_offset = buffer->frame * buffer->frame_size + offset;
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+  GL_STATS_COUNT(uploaded_bytes, size);
+
+  if (buffer->mapped) {
+    memcpy(buffer->mapped + buffer_offset, data, size);
+  } else {
+    // the fences guarantee the GPU is done with this range, so there is no
+    // need for the driver to synchronize with it
+    void *dest = glMapBufferRange(GL_ARRAY_BUFFER, buffer_offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    CORE_ASSERT(dest, "failed to map stream buffer range");
+    memcpy(dest, data, size);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+
+  return buffer_offset;
+}
+
+void stream_buffer_end_frame(StreamBuffer *buffer) {
+  buffer->fences[buffer->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  buffer->frame = (buffer->frame + 1) % STREAM_BUFFER_FRAMES;
+  buffer->offset = 0;
+
+  GLsync fence = buffer->fences[buffer->frame];
+  if (fence) {
+    GLenum res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (res == GL_TIMEOUT_EXPIRED) {
+      res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    glDeleteSync(fence);
+    buffer->fences[buffer->frame] = NULL;
+  }
+}
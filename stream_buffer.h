@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <glad/gl.h>
+
+#include "core.h"
+
+// number of frames the GPU may lag behind the CPU before we have to wait
+#define STREAM_BUFFER_FRAMES 3
+
+// a ring of STREAM_BUFFER_FRAMES slices in a single GL buffer. every frame
+// writes into its own slice so that we never touch memory the GPU may still
+// be reading from, and a fence per slice tells us when it's safe to reuse it.
+typedef struct StreamBuffer {
+  unsigned int id;
+  u32 frame_size;
+  u32 frame;
+  u32 offset;
+  // persistently mapped pointer to the whole buffer when ARB_buffer_storage
+  // is available, NULL otherwise
+  u8 *mapped;
+  GLsync fences[STREAM_BUFFER_FRAMES];
+} StreamBuffer;
+
+void stream_buffer_init(StreamBuffer *buffer, u32 frame_size);
+void stream_buffer_deinit(StreamBuffer *buffer);
+// copies the data into the current frame's slice and returns the byte offset
+// of the copy in the buffer. the buffer is left bound to GL_ARRAY_BUFFER
+u32 stream_buffer_push(StreamBuffer *buffer, const void *data, u32 size, u32 align);
+// fences the current frame's slice and moves on to the next one, waiting for
+// the GPU to finish with it if needed. this MUST be called once per frame
+void stream_buffer_end_frame(StreamBuffer *buffer);
@@ -1,40 +1,51 @@
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_MODULE_H
 #include <glad/glx.h>
 
+#include "gl_stats.h"
 #include "shader.h"
+#include "stream_buffer.h"
 #include "text.h"
 #include "zephr.h"
 
 #define FONT_PIXEL_SIZE 64
+// distance fields scale up well, so the sdf atlas can be a lot smaller
+#define FONT_SDF_PIXEL_SIZE 32
+#define FONT_SDF_SPREAD 4
+// the range of chars that is rasterised when the font is loaded
+#define FONT_FIRST_CHAR 32
+#define FONT_LAST_CHAR 127
+#define FONT_ATLAS_INITIAL_SIZE 512
+#define FONT_ATLAS_MAX_SIZE 4096
+#define TEXT_LAYOUT_CACHE_SIZE 64
 
 Shader font_shader;
 unsigned int font_vao;
-unsigned int font_instance_vbo;
-
-void extend_glyph_instance_list(GlyphInstanceList *dest, GlyphInstanceList *src) {
-  if (dest->size + src->size >= dest->capacity) {
-    dest->capacity = dest->size + src->size;
-    GlyphInstance* temp = realloc(dest->data, dest->capacity * sizeof(GlyphInstance));
-    if (!temp) {
-      printf("[FATAL] Failed to reallocate memory for glyph instance list\n");
-      exit(1);
-    }
-    dest->data = temp;
-  }
+FT_Library ft;
+// null until the first glyph has to be rasterised
+FT_Face font_face;
+const char *font_file_path;
+// where the baked atlas of the font goes, empty if there's no cache directory
+char font_cache_path[PATH_MAX];
+u64 font_file_hash;
 
-  memcpy(dest->data + dest->size, src->data, src->size * sizeof(GlyphInstance));
-  dest->size += src->size;
-}
+TextLayout text_layout_cache[TEXT_LAYOUT_CACHE_SIZE];
+u64 text_layout_cache_clock;
 
 void new_glyph_instance_list(GlyphInstanceList *list, u32 capacity) {
   list->size = 0;
   list->capacity = capacity;
-  list->data = malloc(list->capacity * sizeof(GlyphInstance));
+  list->data = core_arena_alloc(&zephr_ctx.frame_arena, list->capacity * sizeof(GlyphInstance), _Alignof(GlyphInstance));
 }
 
 void clear_glyph_instance_list(GlyphInstanceList *list) {
@@ -42,153 +53,714 @@ void clear_glyph_instance_list(GlyphInstanceList *list) {
   memset(list->data, 0, list->size * sizeof(GlyphInstance));
 }
 
+void reserve_glyph_instance_list(GlyphInstanceList *list, int capacity) {
+  if (capacity <= list->capacity) return;
+
+  int new_capacity = CORE_MAX(capacity, list->capacity * 2);
+  list->data = core_arena_realloc(&zephr_ctx.frame_arena, list->data,
+      list->capacity * sizeof(GlyphInstance), new_capacity * sizeof(GlyphInstance), _Alignof(GlyphInstance));
+  list->capacity = new_capacity;
+}
+
+// points the per instance attributes of the font vao at the instances that
+// start at the given offset of the currently bound array buffer
+void point_glyph_instance_attributes(uptr offset) {
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)offset);
+  glVertexAttribIPointer(2, 1, GL_INT, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f)));
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f) + sizeof(int)));
+  glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f) * 2 + sizeof(int)));
+  glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f) * 3 + sizeof(int)));
+  glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f) * 4 + sizeof(int)));
+  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(offset + sizeof(Vec4f) * 5 + sizeof(int)));
+}
+
 void add_glyph_instance(GlyphInstanceList *list, GlyphInstance instance) {
-  if (list->size >= list->capacity) {
-    list->capacity *= 2;
-    GlyphInstance* temp = realloc(list->data, list->capacity * sizeof(GlyphInstance));
-    if (!temp) {
-      printf("[FATAL] Failed to reallocate memory for glyph instance list\n");
-      exit(1);
-    }
-    list->data = temp;
-  }
+  reserve_glyph_instance_list(list, list->size + 1);
 
   list->data[list->size++] = instance;
 }
 
-int init_freetype(const char* font_path) {
-  FT_Library ft;
+// loads the glyph of the codepoint into face->glyph and renders it in the given mode
+FT_Error render_glyph(FT_Face face, u32 codepoint, FontRenderMode mode) {
+  if (mode == FONT_RENDER_MODE_BITMAP) {
+    return FT_Load_Char(face, codepoint, FT_LOAD_RENDER);
+  }
+
+  FT_Error err = FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT);
+  // glyphs without an outline (e.g. space) have nothing to render
+  if (err || face->glyph->outline.n_points == 0) {
+    return err;
+  }
+
+  return FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF);
+}
+
+// loads the face only when a glyph has to be rasterised, so a font with a baked
+// atlas can start up without touching freetype at all
+int load_font_face(void) {
+  if (font_face) return 0;
+
   if (FT_Init_FreeType(&ft)) {
     return -1;
   }
 
-  FT_Face face;
-  if (FT_New_Face(ft, font_path, 0, &face)) {
+  if (zephr_ctx.font.render_mode == FONT_RENDER_MODE_SDF) {
+    FT_Int spread = FONT_SDF_SPREAD;
+    FT_Property_Set(ft, "sdf", "spread", &spread);
+  }
+
+  if (FT_New_Face(ft, font_file_path, 0, &font_face)) {
+    font_face = NULL;
+    FT_Done_FreeType(ft);
     return -2;
   }
 
   // sets the variable font to be bold
-  /* if ((face->face_flags & FT_FACE_FLAG_MULTIPLE_MASTERS)) { */
+  /* if ((font_face->face_flags & FT_FACE_FLAG_MULTIPLE_MASTERS)) { */
   /*   printf("[INFO] Got a variable font\n"); */
   /*   FT_MM_Var *mm; */
-  /*   FT_Get_MM_Var(face, &mm); */
+  /*   FT_Get_MM_Var(ft, &mm); */
 
-  /*   FT_Set_Var_Design_Coordinates(face, mm->num_namedstyles, mm->namedstyle[mm->num_namedstyles - 4].coords); */
+  /*   FT_Set_Var_Design_Coordinates(font_face, mm->num_namedstyles, mm->namedstyle[mm->num_namedstyles - 4].coords); */
 
   /*   FT_Done_MM_Var(ft, mm); */
   /* } */
 
-  FT_Set_Pixel_Sizes(face, 0, FONT_PIXEL_SIZE);
+  FT_Set_Pixel_Sizes(font_face, 0, zephr_ctx.font.pixel_size);
+
+  return 0;
+}
+
+///////////////////////////
+//
+//
+// Glyph Cache
+//
+//
+///////////////////////////
+
+void skyline_reset(void) {
+  zephr_ctx.font.skyline[0] = (SkylineNode){ .x = 0, .y = 0, .width = zephr_ctx.font.atlas_size };
+  zephr_ctx.font.skyline_count = 1;
+}
+
+// returns the y the rect would sit at if its left edge is placed on the node at
+// idx, or -1 if it doesn't fit in the atlas there
+int skyline_fit(int idx, int width, int height) {
+  ZephrFont *font = &zephr_ctx.font;
+  if (font->skyline[idx].x + width > font->atlas_size) return -1;
+
+  int y = 0;
+  int remaining = width;
+  for (int i = idx; remaining > 0; i++) {
+    y = CORE_MAX(y, font->skyline[i].y);
+    if (y + height > font->atlas_size) return -1;
+    remaining -= font->skyline[i].width;
+  }
+
+  return y;
+}
+
+// finds the lowest spot for the rect, preferring the narrowest node when there
+// are multiple, and raises the skyline over it
+bool skyline_pack(int width, int height, int *x_out, int *y_out) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  int best_idx = -1;
+  int best_y = I32_MAX;
+  int best_width = I32_MAX;
+  for (int i = 0; i < font->skyline_count; i++) {
+    int y = skyline_fit(i, width, height);
+    if (y < 0) continue;
+
+    if (y < best_y || (y == best_y && font->skyline[i].width < best_width)) {
+      best_idx = i;
+      best_y = y;
+      best_width = font->skyline[i].width;
+    }
+  }
+
+  if (best_idx < 0) return false;
+
+  *x_out = font->skyline[best_idx].x;
+  *y_out = best_y;
+
+  CORE_COPY_OVERLAP_ELMT_MANY(&font->skyline[best_idx + 1], &font->skyline[best_idx], font->skyline_count - best_idx);
+  font->skyline[best_idx] = (SkylineNode){ .x = *x_out, .y = best_y + height, .width = width };
+  font->skyline_count++;
+
+  // shrink or remove the nodes that are now under the new one
+  for (int i = best_idx + 1; i < font->skyline_count;) {
+    SkylineNode *prev = &font->skyline[i - 1];
+    SkylineNode *node = &font->skyline[i];
+    int overlap = prev->x + prev->width - node->x;
+    if (overlap <= 0) break;
+
+    if (overlap < node->width) {
+      node->x += overlap;
+      node->width -= overlap;
+      break;
+    }
+
+    CORE_COPY_OVERLAP_ELMT_MANY(node, node + 1, font->skyline_count - i - 1);
+    font->skyline_count--;
+  }
+
+  // merge neighbours at the same height
+  for (int i = 0; i < font->skyline_count - 1;) {
+    if (font->skyline[i].y == font->skyline[i + 1].y) {
+      font->skyline[i].width += font->skyline[i + 1].width;
+      CORE_COPY_OVERLAP_ELMT_MANY(&font->skyline[i + 1], &font->skyline[i + 2], font->skyline_count - i - 2);
+      font->skyline_count--;
+    } else {
+      i++;
+    }
+  }
+
+  return true;
+}
+
+// until init_fonts() created the textures the atlas only lives in memory,
+// init_fonts() uploads it whole
+void upload_atlas(void) {
+  if (!zephr_ctx.font.atlas_texture_id) return;
 
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_2D, zephr_ctx.font.atlas_texture_id);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, zephr_ctx.font.atlas_size, zephr_ctx.font.atlas_size,
+      0, GL_RED, GL_UNSIGNED_BYTE, zephr_ctx.font.atlas_pixels);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-  int pen_x = 0, pen_y = 0;
+void upload_glyph_rect(int slot) {
+  if (!zephr_ctx.font.glyph_rects_buffer_id) return;
 
-  /* FT_UInt glyph_idx; */
-  /* FT_ULong c = FT_Get_First_Char(face, &glyph_idx); */
+  glBindBuffer(GL_TEXTURE_BUFFER, zephr_ctx.font.glyph_rects_buffer_id);
+  glBufferSubData(GL_TEXTURE_BUFFER, slot * sizeof(Vec4f), sizeof(Vec4f), &zephr_ctx.font.glyph_slots[slot].character.tex_rect);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
 
-  u32 tex_width = 0, tex_height = 0;
-  for (u32 i = 32; i < 128; i++) {
-    if (FT_Load_Char(face, i, FT_LOAD_RENDER)) {
-      printf("[ERROR]: failed to load glyph for char '0x%x'\n", i);
+// copies a rect of pixels into the atlas at x, y
+void blit_to_atlas(const u8 *src, int src_pitch, int width, int height, int x, int y) {
+  for (int row = 0; row < height; row++) {
+    memcpy(&zephr_ctx.font.atlas_pixels[(y + row) * zephr_ctx.font.atlas_size + x], &src[row * src_pitch], width);
+  }
+}
+
+// doubles the size of the atlas. the glyphs stay where they are and since the
+// rects are in pixels they don't need to be uploaded again
+bool grow_atlas(void) {
+  ZephrFont *font = &zephr_ctx.font;
+  if (font->atlas_size >= font->max_atlas_size) return false;
+
+  int old_size = font->atlas_size;
+  int new_size = old_size * 2;
+  u8 *pixels = calloc(new_size * new_size, 1);
+  if (!pixels) {
+    printf("[ERROR] Failed to allocate a %dx%d font atlas\n", new_size, new_size);
+    return false;
+  }
+
+  for (int row = 0; row < old_size; row++) {
+    memcpy(&pixels[row * new_size], &font->atlas_pixels[row * old_size], old_size);
+  }
+  free(font->atlas_pixels);
+  font->atlas_pixels = pixels;
+  font->atlas_size = new_size;
+
+  font->skyline[font->skyline_count++] = (SkylineNode){ .x = old_size, .y = 0, .width = old_size };
+
+  upload_atlas();
+
+  return true;
+}
+
+void glyph_map_insert(u32 codepoint, int slot) {
+  u32 idx = (codepoint * 2654435761u) & (FONT_GLYPH_MAP_SIZE - 1);
+  while (zephr_ctx.font.glyph_map[idx] != -1) {
+    idx = (idx + 1) & (FONT_GLYPH_MAP_SIZE - 1);
+  }
+  zephr_ctx.font.glyph_map[idx] = slot;
+}
+
+int glyph_map_find(u32 codepoint) {
+  u32 idx = (codepoint * 2654435761u) & (FONT_GLYPH_MAP_SIZE - 1);
+  while (zephr_ctx.font.glyph_map[idx] != -1) {
+    int slot = zephr_ctx.font.glyph_map[idx];
+    if (zephr_ctx.font.glyph_slots[slot].codepoint == codepoint) {
+      return slot;
     }
+    idx = (idx + 1) & (FONT_GLYPH_MAP_SIZE - 1);
+  }
+  return -1;
+}
 
-    /* FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF); */
+int compare_slots_by_last_used(const void *a, const void *b) {
+  u64 a_last_used = zephr_ctx.font.glyph_slots[*(const int *)a].last_used;
+  u64 b_last_used = zephr_ctx.font.glyph_slots[*(const int *)b].last_used;
+  return (a_last_used > b_last_used) - (a_last_used < b_last_used);
+}
 
-    tex_width += face->glyph->bitmap.width + 1;
-    tex_height = CORE_MAX(tex_height, face->glyph->bitmap.rows);
+// evicts the least recently used half of the glyphs that weren't used in the
+// current frame, then repacks the remaining ones into the freed space.
+// returns false if nothing could be evicted
+bool evict_glyphs(void) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  int order[FONT_GLYPH_SLOTS_COUNT];
+  int used_count = 0;
+  int stale_count = 0;
+  for (int i = 0; i < FONT_GLYPH_SLOTS_COUNT; i++) {
+    if (!font->glyph_slots[i].used) continue;
+    order[used_count++] = i;
+    if (font->glyph_slots[i].last_used < font->frame) stale_count++;
   }
 
-  char *pixels = (char *)calloc(tex_width * tex_height, 1);
+  if (stale_count == 0) return false;
 
-  for (u32 i = 32; i < 128; i++) {
-  /* while (glyph_idx) { */
-    if (FT_Load_Char(face, i, FT_LOAD_RENDER)) {
-      printf("[ERROR]: failed to load glyph for char '0x%x'\n", i);
+  qsort(order, used_count, sizeof(int), compare_slots_by_last_used);
+
+  int evict_count = CORE_MAX(stale_count / 2, 1);
+  for (int i = 0; i < evict_count; i++) {
+    font->glyph_slots[order[i]].used = false;
+  }
+
+  u8 *old_pixels = malloc(font->atlas_size * font->atlas_size);
+  if (!old_pixels) {
+    printf("[FATAL] Failed to allocate memory to repack the font atlas\n");
+    exit(1);
+  }
+  memcpy(old_pixels, font->atlas_pixels, font->atlas_size * font->atlas_size);
+  memset(font->atlas_pixels, 0, font->atlas_size * font->atlas_size);
+  skyline_reset();
+
+  for (int i = evict_count; i < used_count; i++) {
+    Character *ch = &font->glyph_slots[order[i]].character;
+    int x0 = (int)ch->tex_rect.x, y0 = (int)ch->tex_rect.y;
+    int width = (int)ch->tex_rect.z - x0, height = (int)ch->tex_rect.w - y0;
+    if (width == 0) continue;
+
+    int x, y;
+    if (!skyline_pack(width + 1, height + 1, &x, &y)) {
+      printf("[WARN] Font atlas glyph 0x%x didn't fit after repacking, evicting it\n", font->glyph_slots[order[i]].codepoint);
+      font->glyph_slots[order[i]].used = false;
+      continue;
     }
 
-    /* FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF); */
+    blit_to_atlas(&old_pixels[y0 * font->atlas_size + x0], font->atlas_size, width, height, x, y);
+    ch->tex_rect = (Vec4f){ (float)x, (float)y, (float)(x + width), (float)(y + height) };
+    upload_glyph_rect(order[i]);
+  }
 
-    FT_Bitmap *bmp = &face->glyph->bitmap;
+  free(old_pixels);
+  upload_atlas();
 
-    if (pen_x + bmp->width >= tex_width) {
-      pen_x = 0;
-      pen_y += (1 + (face->size->metrics.height >> 6));
+  font->free_slots_count = 0;
+  CORE_ONE_ARRAY(font->glyph_map);
+  for (int i = FONT_GLYPH_SLOTS_COUNT - 1; i >= 0; i--) {
+    if (font->glyph_slots[i].used) {
+      glyph_map_insert(font->glyph_slots[i].codepoint, i);
+    } else {
+      font->free_slots[font->free_slots_count++] = i;
     }
+  }
+
+  font->generation++;
+
+  return true;
+}
 
-    for (u32 row = 0; row < bmp->rows; row++) {
-      for (u32 col = 0; col < bmp->width; col++) {
-        int x = pen_x + col;
-        int y = pen_y + row;
-        pixels[y * tex_width + x] = bmp->buffer[row * bmp->pitch + col];
+// returns the slot of the glyph for the codepoint, rasterising it into the atlas
+// if it isn't there yet. returns -1 if the glyph can't be loaded or there's no
+// room left for it
+int get_glyph_slot(u32 codepoint) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  int slot = glyph_map_find(codepoint);
+  if (slot != -1) {
+    font->glyph_slots[slot].last_used = font->frame;
+    return slot;
+  }
+
+  if (font->free_slots_count == 0 && !evict_glyphs()) {
+    printf("[WARN] No free glyph slots left for glyph 0x%x\n", codepoint);
+    return -1;
+  }
+
+  if (load_font_face() != 0) {
+    printf("[ERROR]: failed to load font \"%s\" to rasterise glyph 0x%x\n", font_file_path, codepoint);
+    return -1;
+  }
+
+  if (render_glyph(font_face, codepoint, font->render_mode)) {
+    printf("[ERROR]: failed to load glyph for codepoint '0x%x'\n", codepoint);
+    return -1;
+  }
+
+  FT_Bitmap *bmp = &font_face->glyph->bitmap;
+  int x = 0, y = 0;
+  if (bmp->width > 0) {
+    // leave a gap after every glyph so linear filtering doesn't bleed
+    // into the neighbouring ones
+    while (!skyline_pack(bmp->width + 1, bmp->rows + 1, &x, &y)) {
+      if (!grow_atlas() && !evict_glyphs()) {
+        printf("[WARN] Font atlas is full, can't fit glyph 0x%x\n", codepoint);
+        return -1;
       }
     }
 
-    float atlas_x0 = (float)pen_x / (float)tex_width;
-    float atlas_y0 = (float)pen_y / (float)tex_height;
-    float atlas_x1 = (float)(pen_x + bmp->width) / (float)tex_width;
-    float atlas_y1 = (float)(pen_y + bmp->rows) / (float)tex_height;
+    blit_to_atlas(bmp->buffer, bmp->pitch, bmp->width, bmp->rows, x, y);
+
+    if (font->atlas_texture_id) {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, font->atlas_size);
+      glBindTexture(GL_TEXTURE_2D, font->atlas_texture_id);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bmp->width, bmp->rows, GL_RED, GL_UNSIGNED_BYTE,
+          &font->atlas_pixels[y * font->atlas_size + x]);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+  }
+
+  slot = font->free_slots[--font->free_slots_count];
+  GlyphSlot *glyph = &font->glyph_slots[slot];
+  glyph->codepoint = codepoint;
+  glyph->used = true;
+  glyph->last_used = font->frame;
+
+  Character *character = &glyph->character;
+  character->tex_rect = (Vec4f){ (float)x, (float)y, (float)(x + bmp->width), (float)(y + bmp->rows) };
+  character->advance = font_face->glyph->advance.x;
+  // the metrics are those of the glyph itself. the distance field spread that
+  // surrounds an sdf glyph is added back when the quads are laid out
+  int padding = bmp->width ? font->padding : 0;
+  character->size = (Size){ .width = bmp->width - padding * 2, .height = bmp->rows - padding * 2 };
+  character->bearing = (Size){ .width = font_face->glyph->bitmap_left + padding, .height = font_face->glyph->bitmap_top - padding };
+
+  upload_glyph_rect(slot);
+  glyph_map_insert(codepoint, slot);
+
+  return slot;
+}
+
+// empties the glyph cache and sets the atlas back to its initial size
+void reset_glyph_cache(void) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  font->atlas_size = FONT_ATLAS_INITIAL_SIZE;
+  u8 *pixels = realloc(font->atlas_pixels, font->atlas_size * font->atlas_size);
+  if (!pixels) {
+    printf("[FATAL] Failed to allocate the font atlas\n");
+    exit(1);
+  }
+  font->atlas_pixels = pixels;
+  memset(font->atlas_pixels, 0, font->atlas_size * font->atlas_size);
+  skyline_reset();
+
+  CORE_ONE_ARRAY(font->glyph_map);
+  font->free_slots_count = 0;
+  for (int i = FONT_GLYPH_SLOTS_COUNT - 1; i >= 0; i--) {
+    font->glyph_slots[i].used = false;
+    font->free_slots[font->free_slots_count++] = i;
+  }
+}
+
+///////////////////////////
+//
+//
+// Baked Atlas Cache
+//
+//
+///////////////////////////
+
+// the atlas with the up front glyphs is baked to
+// $XDG_CACHE_HOME/zephr/fonts/<font hash>-<mode>-<pixel size>.atlas
+// after it is built with freetype, and later launches map it instead.
+// the file is laid out as the header, the glyphs, the skyline nodes and then
+// atlas_size * atlas_size bytes of pixels
+#define FONT_ATLAS_CACHE_MAGIC 0x4341465a // "ZFAC"
+#define FONT_ATLAS_CACHE_VERSION 1
+
+typedef struct FontAtlasCacheHeader {
+  u32 magic;
+  u32 version;
+  u64 font_hash;
+  u32 render_mode;
+  u32 pixel_size;
+  u32 padding;
+  u32 atlas_size;
+  u32 glyphs_count;
+  u32 skyline_count;
+} FontAtlasCacheHeader;
+
+typedef struct FontAtlasCacheGlyph {
+  u32 codepoint;
+  Character character;
+} FontAtlasCacheGlyph;
+
+// hashes the contents of the font file. returns false if it can't be read
+bool hash_font_file(const char *path, u64 *hash_out) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
 
-    Vec2f top_left = (Vec2f){ .x = atlas_x0, .y = atlas_y1 };
-    Vec2f top_right = (Vec2f){ .x = atlas_x1, .y = atlas_y1 };
-    Vec2f bottom_right = (Vec2f){ .x = atlas_x1, .y = atlas_y0 };
-    Vec2f bottom_left = (Vec2f){ .x = atlas_x0, .y = atlas_y0 };
+  *hash_out = core_hash_fnv1a_64(data, st.st_size, CORE_FNV1A_64_SEED);
+  munmap(data, st.st_size);
 
-    Character character;
+  return true;
+}
 
-    character.tex_coords[0] = top_left;
-    character.tex_coords[1] = top_right;
-    character.tex_coords[2] = bottom_right;
-    character.tex_coords[3] = bottom_left;
-    character.advance = face->glyph->advance.x;
-    character.size = (Size){ .width = face->glyph->bitmap.width, .height = face->glyph->bitmap.rows };
-    character.bearing = (Size){ .width = face->glyph->bitmap_left, .height = face->glyph->bitmap_top };
+// writes the path of the cache file into path_out and creates its directory.
+// returns false if there's no cache directory to use
+bool get_atlas_cache_path(u64 font_hash, char *path_out, int path_size) {
+  char dir[PATH_MAX];
+  if (!core_cache_dir("zephr/fonts", dir, sizeof(dir))) return false;
 
-    zephr_ctx.font.characters[i] = character;
+  snprintf(path_out, path_size, "%s/%016llx-%s-%d.atlas", dir, (unsigned long long)font_hash,
+      zephr_ctx.font.render_mode == FONT_RENDER_MODE_SDF ? "sdf" : "bitmap", zephr_ctx.font.pixel_size);
 
-    pen_x += bmp->width + 1;
+  return true;
+}
 
-    /* c = FT_Get_Next_Char(face, c, &glyph_idx); */
+// checks that the glyphs and the skyline of a baked atlas stay inside it, so
+// a corrupt file can't make the shader sample outside a glyph or break the
+// packing of the next glyphs
+bool is_baked_atlas_in_bounds(const FontAtlasCacheHeader *header, const FontAtlasCacheGlyph *glyphs, const SkylineNode *skyline) {
+  float size = (float)header->atlas_size;
+  for (u32 i = 0; i < header->glyphs_count; i++) {
+    Vec4f rect = glyphs[i].character.tex_rect;
+    // written so that nan fails too
+    if (!(0.f <= rect.x && rect.x <= rect.z && rect.z <= size && 0.f <= rect.y && rect.y <= rect.w && rect.w <= size)) {
+      return false;
+    }
   }
 
-  unsigned int texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, tex_width,
-      tex_height, 0, GL_RED, GL_UNSIGNED_BYTE,
-      pixels);
+  // the nodes cover the width of the atlas from left to right without gaps
+  int x = 0;
+  for (u32 i = 0; i < header->skyline_count; i++) {
+    const SkylineNode *node = &skyline[i];
+    if (node->x != x || node->width < 1 || node->width > (int)header->atlas_size - x ||
+        node->y < 0 || node->y > (int)header->atlas_size) {
+      return false;
+    }
+    x += node->width;
+  }
 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  return x == (int)header->atlas_size;
+}
 
-  zephr_ctx.font.atlas_texture_id = texture;
+// restores the glyph cache from the baked atlas. returns false if there's no
+// usable file, in which case the glyph cache is left empty
+bool load_baked_atlas(const char *path, u64 font_hash) {
+  ZephrFont *font = &zephr_ctx.font;
 
-  glBindTexture(GL_TEXTURE_2D, 0);
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return false;
 
-  FT_Done_Face(face);
-  FT_Done_FreeType(ft);
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (u64)st.st_size < sizeof(FontAtlasCacheHeader)) {
+    close(fd);
+    return false;
+  }
 
-  free(pixels);
+  u8 *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  FontAtlasCacheHeader *header = (FontAtlasCacheHeader *)data;
+  u64 glyphs_offset = sizeof(FontAtlasCacheHeader);
+  u64 skyline_offset = glyphs_offset + (u64)header->glyphs_count * sizeof(FontAtlasCacheGlyph);
+  u64 pixels_offset = skyline_offset + (u64)header->skyline_count * sizeof(SkylineNode);
+  u64 expected_size = pixels_offset + (u64)header->atlas_size * header->atlas_size;
+
+  if (header->magic != FONT_ATLAS_CACHE_MAGIC ||
+      header->version != FONT_ATLAS_CACHE_VERSION ||
+      header->font_hash != font_hash ||
+      header->render_mode != (u32)font->render_mode ||
+      header->pixel_size != (u32)font->pixel_size ||
+      header->padding != (u32)font->padding ||
+      header->atlas_size < FONT_ATLAS_INITIAL_SIZE ||
+      header->atlas_size > (u32)font->max_atlas_size ||
+      header->glyphs_count > FONT_GLYPH_SLOTS_COUNT ||
+      header->skyline_count > header->atlas_size ||
+      (u64)st.st_size != expected_size ||
+      !is_baked_atlas_in_bounds(header, (FontAtlasCacheGlyph *)(data + glyphs_offset), (SkylineNode *)(data + skyline_offset))) {
+    printf("[WARN] Ignoring stale font atlas cache \"%s\"\n", path);
+    munmap(data, st.st_size);
+    return false;
+  }
 
-  return 0;
+  font->atlas_size = (int)header->atlas_size;
+  u8 *pixels = realloc(font->atlas_pixels, font->atlas_size * font->atlas_size);
+  if (!pixels) {
+    printf("[FATAL] Failed to allocate the font atlas\n");
+    exit(1);
+  }
+  font->atlas_pixels = pixels;
+  memcpy(font->atlas_pixels, data + pixels_offset, font->atlas_size * font->atlas_size);
+
+  font->skyline_count = (int)header->skyline_count;
+  memcpy(font->skyline, data + skyline_offset, header->skyline_count * sizeof(SkylineNode));
+
+  // the rects are uploaded with the atlas by init_fonts()
+  FontAtlasCacheGlyph *glyphs = (FontAtlasCacheGlyph *)(data + glyphs_offset);
+  for (u32 i = 0; i < header->glyphs_count; i++) {
+    if (glyph_map_find(glyphs[i].codepoint) != -1) {
+      printf("[WARN] Ignoring font atlas cache \"%s\" with glyph 0x%x in it twice\n", path, glyphs[i].codepoint);
+      reset_glyph_cache();
+      munmap(data, st.st_size);
+      return false;
+    }
+
+    int slot = font->free_slots[--font->free_slots_count];
+    GlyphSlot *glyph = &font->glyph_slots[slot];
+    glyph->codepoint = glyphs[i].codepoint;
+    glyph->used = true;
+    glyph->last_used = font->frame;
+    glyph->character = glyphs[i].character;
+    glyph_map_insert(glyph->codepoint, slot);
+  }
+
+  munmap(data, st.st_size);
+
+  return true;
 }
 
-int init_fonts(const char *font_path) {
-  u32 font_vbo;
-  u32 font_ebo;
+// writes the current glyph cache to a temporary file and renames it over the
+// cache file so a partly written file is never picked up
+void save_baked_atlas(const char *path, u64 font_hash) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  char tmp_path[PATH_MAX];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
 
-  int res = init_freetype(font_path);
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file) {
+    printf("[WARN] Failed to create font atlas cache \"%s\"\n", tmp_path);
+    return;
+  }
+
+  FontAtlasCacheHeader header = {
+    .magic = FONT_ATLAS_CACHE_MAGIC,
+    .version = FONT_ATLAS_CACHE_VERSION,
+    .font_hash = font_hash,
+    .render_mode = font->render_mode,
+    .pixel_size = font->pixel_size,
+    .padding = font->padding,
+    .atlas_size = font->atlas_size,
+    .skyline_count = font->skyline_count,
+  };
+  for (int i = 0; i < FONT_GLYPH_SLOTS_COUNT; i++) {
+    if (font->glyph_slots[i].used) header.glyphs_count++;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (int i = 0; ok && i < FONT_GLYPH_SLOTS_COUNT; i++) {
+    if (!font->glyph_slots[i].used) continue;
+
+    FontAtlasCacheGlyph glyph = {
+      .codepoint = font->glyph_slots[i].codepoint,
+      .character = font->glyph_slots[i].character,
+    };
+    ok = fwrite(&glyph, sizeof(glyph), 1, file) == 1;
+  }
+  ok = ok && fwrite(font->skyline, sizeof(SkylineNode), font->skyline_count, file) == (size_t)font->skyline_count;
+  ok = ok && fwrite(font->atlas_pixels, font->atlas_size, font->atlas_size, file) == (size_t)font->atlas_size;
+
+  if (fclose(file) != 0 || !ok || rename(tmp_path, path) == -1) {
+    printf("[WARN] Failed to write font atlas cache \"%s\"\n", path);
+    remove(tmp_path);
+  }
+}
+
+// rasterises the glyphs that are used all the time and bakes them for the
+// next launch
+void rasterise_up_front_glyphs(void) {
+  for (u32 c = FONT_FIRST_CHAR; c < FONT_LAST_CHAR; c++) {
+    get_glyph_slot(c);
+  }
+
+  if (font_cache_path[0]) {
+    save_baked_atlas(font_cache_path, font_file_hash);
+  }
+}
+
+int load_fonts(const char *font_path) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  font_file_path = font_path;
+  if (font->render_mode == FONT_RENDER_MODE_SDF) {
+    font->pixel_size = FONT_SDF_PIXEL_SIZE;
+    font->padding = FONT_SDF_SPREAD;
+  } else {
+    font->pixel_size = FONT_PIXEL_SIZE;
+    font->padding = 0;
+  }
+
+  // init_fonts() lowers it to what the gpu can take
+  font->max_atlas_size = FONT_ATLAS_MAX_SIZE;
+  // a node is at least a pixel wide, plus one for the node being inserted
+  font->skyline = malloc((font->max_atlas_size + 1) * sizeof(SkylineNode));
+  if (!font->skyline) {
+    printf("[FATAL] Failed to allocate the font atlas\n");
+    exit(1);
+  }
+  reset_glyph_cache();
+
+  if (!hash_font_file(font_path, &font_file_hash)) {
+    return -2;
+  }
+
+  if (!get_atlas_cache_path(font_file_hash, font_cache_path, sizeof(font_cache_path))) {
+    font_cache_path[0] = '\0';
+  }
+  if (font_cache_path[0] && load_baked_atlas(font_cache_path, font_file_hash)) {
+    return 0;
+  }
+
+  int res = load_font_face();
   if (res != 0) {
     return res;
   }
 
+  // ascii is used all the time so rasterise it up front
+  rasterise_up_front_glyphs();
+
+  return 0;
+}
+
+void deinit_fonts(void) {
+  glDeleteTextures(1, &zephr_ctx.font.atlas_texture_id);
+  glDeleteTextures(1, &zephr_ctx.font.glyph_rects_texture_id);
+  glDeleteBuffers(1, &zephr_ctx.font.glyph_rects_buffer_id);
+  free(zephr_ctx.font.atlas_pixels);
+  free(zephr_ctx.font.skyline);
+
+  if (font_face) {
+    FT_Done_Face(font_face);
+    FT_Done_FreeType(ft);
+    font_face = NULL;
+  }
+}
+
+// renders the text in zephr_ctx.font.render_mode
+void init_text(void) {
+  u32 font_vbo;
+  u32 font_ebo;
+
   font_shader = create_shader("shaders/font.vert", "shaders/font.frag");
 
   glGenVertexArrays(1, &font_vao);
   glGenBuffers(1, &font_vbo);
-  glGenBuffers(1, &font_instance_vbo);
   glGenBuffers(1, &font_ebo);
 
   float quad_vertices[4][2] = {
@@ -211,197 +783,302 @@ int init_fonts(const char *font_path) {
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
 
-  // font instance vbo
-  glBindBuffer(GL_ARRAY_BUFFER, font_instance_vbo);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)0);
-  glVertexAttribDivisor(1, 1);
-  glEnableVertexAttribArray(2);
-  glVertexAttribIPointer(2, 1, GL_INT, sizeof(GlyphInstance), (void *)sizeof(Vec4f));
-  glVertexAttribDivisor(2, 1);
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(sizeof(Vec4f) + sizeof(int)));
-  glVertexAttribDivisor(3, 1);
-  glEnableVertexAttribArray(4);
-  glEnableVertexAttribArray(5);
-  glEnableVertexAttribArray(6);
-  glEnableVertexAttribArray(7);
-  glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(sizeof(Vec4f) * 2 + sizeof(int)));
-  glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(sizeof(Vec4f) * 3 + sizeof(int)));
-  glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(sizeof(Vec4f) * 4 + sizeof(int)));
-  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void *)(sizeof(Vec4f) * 5 + sizeof(int)));
-  glVertexAttribDivisor(4, 1);
-  glVertexAttribDivisor(5, 1);
-  glVertexAttribDivisor(6, 1);
-  glVertexAttribDivisor(7, 1);
+  // per instance attributes. they're pointed at the streaming buffer on every draw
+  for (u32 i = 1; i <= 7; i++) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
 
   // font ebo
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, font_ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_indices), quad_indices, GL_STATIC_DRAW);
 
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+
   use_shader(font_shader);
+  set_int(font_shader, "text", 0);
+  set_int(font_shader, "glyph_rects", 1);
+  set_int(font_shader, "sdf", zephr_ctx.font.render_mode == FONT_RENDER_MODE_SDF);
+  set_text_outline(0.f, NULL);
+}
 
-  for (int i = 32; i < 128; i++) {
-    for (int j = 0; j < 4; j++) {
-      char text[32];
-      snprintf(text, 32, "texcoords[%d]", (i - 32) * 4 + j);
-      set_vec2f(font_shader, text, zephr_ctx.font.characters[i].tex_coords[j].x, zephr_ctx.font.characters[i].tex_coords[j].y);
+int init_fonts(void) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  int max_texture_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+  font->max_atlas_size = CORE_MIN(font->max_atlas_size, max_texture_size);
+  if (font->atlas_size > font->max_atlas_size) {
+    // the baked atlas was grown on a gpu that takes bigger textures, like
+    // when the cache directory is shared between machines. start over from
+    // the initial size, which also bakes the atlas again for this gpu
+    printf("[WARN] Baked font atlas is bigger than the gpu allows (%d > %d), rasterising it again\n",
+        font->atlas_size, font->max_atlas_size);
+    reset_glyph_cache();
+    if (font->atlas_size > font->max_atlas_size) {
+      return -3;
     }
+    rasterise_up_front_glyphs();
   }
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  glGenTextures(1, &font->atlas_texture_id);
+  glBindTexture(GL_TEXTURE_2D, font->atlas_texture_id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // the glyph rects live in a texture buffer that the vertex shader indexes
+  // with the glyph slot. every slot is uploaded, the unused ones are never
+  // looked up
+  Vec4f *glyph_rects = calloc(FONT_GLYPH_SLOTS_COUNT, sizeof(Vec4f));
+  if (!glyph_rects) {
+    printf("[FATAL] Failed to allocate the glyph rects\n");
+    exit(1);
+  }
+  for (int i = 0; i < FONT_GLYPH_SLOTS_COUNT; i++) {
+    if (font->glyph_slots[i].used) glyph_rects[i] = font->glyph_slots[i].character.tex_rect;
+  }
+  glGenBuffers(1, &font->glyph_rects_buffer_id);
+  glBindBuffer(GL_TEXTURE_BUFFER, font->glyph_rects_buffer_id);
+  glBufferData(GL_TEXTURE_BUFFER, FONT_GLYPH_SLOTS_COUNT * sizeof(Vec4f), glyph_rects, GL_DYNAMIC_DRAW);
+  free(glyph_rects);
+
+  glGenTextures(1, &font->glyph_rects_texture_id);
+  glBindTexture(GL_TEXTURE_BUFFER, font->glyph_rects_texture_id);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, font->glyph_rects_buffer_id);
+
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  upload_atlas();
 
   return 0;
 }
 
-Sizef calculate_text_size(const char *text, int font_size) {
-  float scale = (float)font_size / FONT_PIXEL_SIZE;
-  Sizef size = { .width = 0, .height = 0 };
+// reallocs the buffer to fit the new capacity. exits if that fails
+void *grow_buffer(void *data, u64 size, const char *what) {
+  void *temp = realloc(data, size);
+  if (!temp) {
+    printf("[FATAL] Failed to reallocate memory for %s\n", what);
+    exit(1);
+  }
+  return temp;
+}
+
+void layout_text(TextLayout *layout, const char *text) {
+  ZephrFont *font = &zephr_ctx.font;
+
+  // look up the glyph of every codepoint first. this rasterises the ones that
+  // aren't in the atlas yet, which can evict glyphs and bump the generation
+  layout->glyphs_count = 0;
+  for (uptr i = 0; i < (uptr)layout->text_length;) {
+    u32 codepoint = core_utf8_decode(text, layout->text_length, &i);
+    int slot = get_glyph_slot(codepoint);
+    if (slot != -1) {
+      layout->glyphs[layout->glyphs_count++].tex_coords_index = slot;
+    }
+  }
+  layout->font_generation = font->generation;
+
+  if (layout->glyphs_count == 0) {
+    layout->size = (Sizef){0};
+    return;
+  }
+
+  int max_bearing_h = 0;
+  for (int i = 0; i < layout->glyphs_count; i++) {
+    Character *ch = &font->glyph_slots[layout->glyphs[i].tex_coords_index].character;
+    max_bearing_h = CORE_MAX(max_bearing_h, ch->bearing.height);
+  }
+
+  int first_char_bearing_w = font->glyph_slots[layout->glyphs[0].tex_coords_index].character.bearing.width;
+
+  // we use the original text and character sizes here and then we just
+  // scale up or down the model matrix to get the desired font size.
+  // this way everything works out fine and we get to transform the text using the
+  // model matrix
+  int x = 0;
   int w = 0;
   int h = 0;
-  int max_bearing_h = 0;
+  for (int i = 0; i < layout->glyphs_count; i++) {
+    Character *ch = &font->glyph_slots[layout->glyphs[i].tex_coords_index].character;
+    // subtract the bearing width of the first character to remove the extra space
+    // at the start of the text and move every char to the left by that width
+    float xpos = (float)(x + (ch->bearing.width - first_char_bearing_w));
+    float ypos = (float)(max_bearing_h - ch->bearing.height);
 
-  // NOTE: I don't like looping through the characters twice, but it's fine for now
-  for (int i = 0; text[i] != '\0'; i++) {
-    Character ch = zephr_ctx.font.characters[(u32)text[i]];
-    max_bearing_h = CORE_MAX(max_bearing_h, ch.bearing.height);
-  }
+    // sdf glyphs are surrounded by the spread of the distance field, which has
+    // to be drawn too
+    int padding = ch->size.width ? font->padding : 0;
 
-  for (u64 i = 0; text[i] != '\0'; i++) {
-    Character ch = zephr_ctx.font.characters[(u32)text[i]];
-    w += ch.advance / 64;
+    layout->glyphs[i].position = (Vec4f){xpos - padding, ypos - padding, ch->size.width + padding * 2, ch->size.height + padding * 2};
 
-    // remove bearing of first character
-    if (i == 0 && strlen(text) > 1) {
-      w -= ch.bearing.width;
-    }
+    x += (ch->advance >> 6);
+    w += (ch->advance >> 6);
 
     // remove the trailing width of the last character
-    if (i == strlen(text) - 1) {
-      w -= ((ch.advance / 64) - (ch.bearing.width + ch.size.width));
+    if (i == layout->glyphs_count - 1) {
+      w -= ((ch->advance >> 6) - (ch->bearing.width + ch->size.width));
     }
 
-    // if we only have one character in the text, then remove the bearing width
-    if (strlen(text) == 1) {
-      w -= (ch.bearing.width);
+    h = CORE_MAX(h, max_bearing_h - ch->bearing.height + ch->size.height);
+  }
+
+  // remove bearing of first character
+  w -= first_char_bearing_w;
+
+  layout->size = (Sizef){ .width = (float)w, .height = (float)h };
+}
+
+// returns the cached layout of the text, laying it out on a miss.
+// the least recently used layout is evicted when the cache is full
+TextLayout *get_text_layout(const char *text) {
+  int length = (int)strlen(text);
+  u64 hash = core_hash_fnv1a_64(text, length, CORE_FNV1A_64_SEED);
+
+  text_layout_cache_clock++;
+
+  TextLayout *lru = &text_layout_cache[0];
+  for (int i = 0; i < TEXT_LAYOUT_CACHE_SIZE; i++) {
+    TextLayout *layout = &text_layout_cache[i];
+    if (layout->text && layout->hash == hash && layout->text_length == length &&
+        memcmp(layout->text, text, length) == 0) {
+      layout->last_used = text_layout_cache_clock;
+      if (layout->font_generation != zephr_ctx.font.generation) {
+        layout_text(layout, text);
+      } else {
+        // keep the glyphs from being evicted while they're in use
+        for (int j = 0; j < layout->glyphs_count; j++) {
+          zephr_ctx.font.glyph_slots[layout->glyphs[j].tex_coords_index].last_used = zephr_ctx.font.frame;
+        }
+      }
+      return layout;
     }
 
-    h = CORE_MAX(h, max_bearing_h - ch.bearing.height + ch.size.height);
+    if (layout->last_used < lru->last_used) {
+      lru = layout;
+    }
   }
-  size.width = (float)w * scale;
-  size.height = (float)h * scale;
-  return size;
-}
 
-GlyphInstanceList get_glyph_instance_list_from_text(const char *text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment) {
-  use_shader(font_shader);
-  Color text_color = { 0, 0, 0, 1.f };
-  if (color) {
-    text_color = (Color){ color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f };
+  if (lru->text_capacity < length + 1) {
+    lru->text_capacity = length + 1;
+    lru->text = grow_buffer(lru->text, lru->text_capacity, "text layout");
+  }
+  if (lru->glyphs_capacity < length) {
+    lru->glyphs_capacity = length;
+    lru->glyphs = grow_buffer(lru->glyphs, lru->glyphs_capacity * sizeof(LayoutGlyph), "text layout glyphs");
   }
-  set_mat4f(font_shader, "projection", (float *)zephr_ctx.projection.m);
 
-  Vec2f pos = { 0.f, 0.f };
-  Sizef size = {0};
+  memcpy(lru->text, text, length + 1);
+  lru->hash = hash;
+  lru->text_length = length;
+  lru->last_used = text_layout_cache_clock;
+  layout_text(lru, text);
 
-  apply_constraints(constraints, &pos, &size);
+  return lru;
+}
 
-  Sizef text_size = calculate_text_size(text, FONT_PIXEL_SIZE);
-  float font_scale = (float)font_size / FONT_PIXEL_SIZE * size.width;
+// the outline is only drawn with an sdf atlas. the width is in atlas pixels and
+// can't be wider than the spread of the distance field
+void set_text_outline(float width, const Color *color) {
+  if (zephr_ctx.font.render_mode != FONT_RENDER_MODE_SDF) return;
 
-  apply_alignment(alignment, &pos, (Sizef){ text_size.width * font_scale, text_size.height * font_scale });
+  width = CORE_MIN(width, (float)FONT_SDF_SPREAD);
 
-  Matrix4x4 model = identity();
-  apply_scale(&model, (Sizef){font_scale, font_scale});
+  // the distance field maps [-spread, spread] pixels to [0, 1]
+  zephr_ctx.font.outline_width = width / (FONT_SDF_SPREAD * 2.f);
+  if (color) {
+    zephr_ctx.font.outline_color = (Color){ color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f };
+  } else {
+    zephr_ctx.font.outline_color = (Color){ 0.f, 0.f, 0.f, 1.f };
+  }
+}
 
-  // rotate around the center point of the text
-  apply_translation(&model, (Vec2f){-text_size.width * font_scale / 2.f, -text_size.height * font_scale / 2.f});
-  apply_rotation(&model, to_radians(constraints.rotation));
-  apply_translation(&model, (Vec2f){text_size.width *font_scale / 2.f, text_size.height * font_scale / 2.f});
+Sizef calculate_text_size(const char *text, int font_size) {
+  float scale = (float)font_size / zephr_ctx.font.pixel_size;
+  TextLayout *layout = get_text_layout(text);
 
-  apply_translation(&model, pos);
+  return (Sizef){ .width = layout->size.width * scale, .height = layout->size.height * scale };
+}
 
-  int max_bearing_h = 0;
-  for (int i = 0; (i < text[i]) != '\0'; i++) {
-    Character ch = zephr_ctx.font.characters[(int)text[i]];
-    max_bearing_h = CORE_MAX(max_bearing_h, ch.bearing.height);
+void add_text_glyphs(GlyphInstanceList *list, const char *text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment) {
+  Color text_color = { 0, 0, 0, 1.f };
+  if (color) {
+    text_color = (Color){ color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f };
   }
 
-  float first_char_bearing_w = zephr_ctx.font.characters[(int)text[0]].bearing.width;
+  Vec2f pos = { 0.f, 0.f };
+  Sizef size = {0};
 
-  GlyphInstanceList glyph_instance_list;
-  new_glyph_instance_list(&glyph_instance_list, 16);
+  apply_constraints(constraints, &pos, &size);
 
-  // we use the original text and character sizes in the loop and then we just
-  // scale up or down the model matrix to get the desired font size.
-  // this way everything works out fine and we get to transform the text using the
-  // model matrix
-  int c = 0;
-  int x = 0;
-  while (text[c] != '\0') {
-    Character ch = zephr_ctx.font.characters[(int)text[c]];
-    // subtract the bearing width of the first character to remove the extra space
-    // at the start of the text and move every char to the left by that width
-    float xpos = (x + (ch.bearing.width - first_char_bearing_w));
-    float ypos = (text_size.height - ch.bearing.height - (text_size.height - max_bearing_h));
-
-    GlyphInstance instance = {
-      .position = (Vec4f){xpos, ypos, ch.size.width, ch.size.height},
-      .tex_coords_index = (int)text[c] - 32,
-      .color = text_color,
-      .model = {{0}},
-    };
+  TextLayout *layout = get_text_layout(text);
+  Sizef text_size = layout->size;
+  float font_scale = (float)font_size / zephr_ctx.font.pixel_size * size.width;
 
-    memcpy(instance.model, model.m, sizeof(float[4][4]));
-    
-    add_glyph_instance(&glyph_instance_list, instance);
+  apply_alignment(alignment, &pos, (Sizef){ text_size.width * font_scale, text_size.height * font_scale });
 
-    x += (ch.advance >> 6); 
-    c++;
+  // rotate around the center point of the text
+  Vec2f center = { text_size.width * font_scale / 2.f, text_size.height * font_scale / 2.f };
+  Affine2D transform = affine_scale_rotate_translate((Sizef){font_scale, font_scale}, to_radians(constraints.rotation), center, pos);
+  Matrix4x4 model = affine_to_matrix4x4(&transform);
+
+  reserve_glyph_instance_list(list, list->size + layout->glyphs_count);
+
+  for (int i = 0; i < layout->glyphs_count; i++) {
+    GlyphInstance *instance = &list->data[list->size++];
+    instance->position = layout->glyphs[i].position;
+    instance->tex_coords_index = layout->glyphs[i].tex_coords_index;
+    instance->color = text_color;
+    memcpy(instance->model, model.m, sizeof(float[4][4]));
   }
-
-  return glyph_instance_list;
 }
 
 void draw_text(const char* text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment) {
-  GlyphInstanceList glyph_instance_list = get_glyph_instance_list_from_text(text, font_size, constraints, color, alignment);
+  GlyphInstanceList glyph_instance_list;
+  new_glyph_instance_list(&glyph_instance_list, (u32)strlen(text));
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, zephr_ctx.font.atlas_texture_id);
-  glBindVertexArray(font_vao);
+  add_text_glyphs(&glyph_instance_list, text, font_size, constraints, color, alignment);
 
-  glBindBuffer(GL_ARRAY_BUFFER, font_instance_vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GlyphInstance) * glyph_instance_list.size, glyph_instance_list.data, GL_DYNAMIC_DRAW);
+  draw_text_batch(&glyph_instance_list);
+}
 
-  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, glyph_instance_list.size);
+// the glyphs are pushed to the renderer with the current outline and drawn
+// when the frame is flushed
+void draw_text_batch(GlyphInstanceList *batch) {
+  renderer_push_glyphs(&zephr_ctx.renderer, batch->data, batch->size, zephr_ctx.font.outline_width, &zephr_ctx.font.outline_color);
+}
 
-  glBindVertexArray(0);
-  glBindTexture(GL_TEXTURE_2D, 0);
+void draw_glyph_instances(const GlyphInstance *instances, int instances_count, float outline_width, const Color *outline_color) {
+  if (instances_count == 0) return;
 
-  free(glyph_instance_list.data);
-}
+  use_shader(font_shader);
+  // the projection changes when the window is resized
+  set_mat4f(font_shader, "projection", (float *)zephr_ctx.projection.m);
+  set_float(font_shader, "outlineWidth", outline_width);
+  set_vec4f(font_shader, "outlineColor", outline_color->r, outline_color->g, outline_color->b, outline_color->a);
 
-void draw_text_batch(GlyphInstanceList *batch) {
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, zephr_ctx.font.atlas_texture_id);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, zephr_ctx.font.glyph_rects_texture_id);
   glBindVertexArray(font_vao);
 
-  glBindBuffer(GL_ARRAY_BUFFER, font_instance_vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GlyphInstance) * batch->size, batch->data, GL_DYNAMIC_DRAW);
+  u32 offset = stream_buffer_push(&zephr_ctx.instance_stream, instances, sizeof(GlyphInstance) * instances_count, 16);
+  point_glyph_instance_attributes(offset);
 
-  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, batch->size);
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, instances_count);
 
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, 0);
-
-  free(batch->data);
 }
 
 void add_text_instance(GlyphInstanceList *batch, const char* text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment) {
-  GlyphInstanceList glyph_instance_list = get_glyph_instance_list_from_text(text, font_size, constraints, color, alignment);
-
-  extend_glyph_instance_list(batch, &glyph_instance_list);
-
-  free(glyph_instance_list.data);
+  add_text_glyphs(batch, text, font_size, constraints, color, alignment);
 }
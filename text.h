@@ -4,16 +4,78 @@
 #include "ui.h"
 #include "zephr_math.h"
 
+// the number of glyphs that can be in the atlas at once
+#define FONT_GLYPH_SLOTS_COUNT 1024
+// must be a power of two and bigger than FONT_GLYPH_SLOTS_COUNT
+#define FONT_GLYPH_MAP_SIZE 2048
+
 typedef struct Character {
   Size size;
   Size bearing;
   unsigned int advance;
-  Vec2f tex_coords[4]; // the 4 corners of the character quad
+  Vec4f tex_rect; // x0, y0, x1, y1 of the character in the atlas in pixels
 } Character;
 
+typedef enum FontRenderMode {
+  // plain coverage bitmaps
+  FONT_RENDER_MODE_BITMAP,
+  // signed distance fields that stay sharp at any scale
+  FONT_RENDER_MODE_SDF,
+} FontRenderMode;
+
+typedef struct GlyphSlot {
+  u32 codepoint;
+  bool used;
+  // the frame the glyph was last laid out in. glyphs used in the current frame
+  // are never evicted since they might already be batched
+  u64 last_used;
+  Character character;
+} GlyphSlot;
+
+// the top edge of the packed glyphs over [x, x + width) of the atlas
+typedef struct SkylineNode {
+  int x;
+  int y;
+  int width;
+} SkylineNode;
+
 typedef struct ZephrFont {
-  Character characters[128];
+  FontRenderMode render_mode;
+  // the size the glyphs are rasterised at in the atlas
+  int pixel_size;
+  // the empty space around every glyph in the atlas
+  int padding;
+
+  // glyphs are rasterised into the atlas the first time they're laid out.
+  // the map goes from codepoint to slot index using linear probing, with -1
+  // marking an empty entry. the slot index is also the glyph's index into the
+  // glyph rects texture buffer
+  int glyph_map[FONT_GLYPH_MAP_SIZE];
+  GlyphSlot glyph_slots[FONT_GLYPH_SLOTS_COUNT];
+  int free_slots[FONT_GLYPH_SLOTS_COUNT];
+  int free_slots_count;
+  // bumped whenever glyphs are evicted so that cached layouts get redone
+  u32 generation;
+  u64 frame;
+
+  // the atlas is square and grows until it hits max_atlas_size, after which
+  // the least recently used glyphs are evicted
+  int atlas_size;
+  int max_atlas_size;
+  // cpu copy of the atlas, used to grow and repack it
+  u8 *atlas_pixels;
+  SkylineNode *skyline;
+  int skyline_count;
+
   unsigned int atlas_texture_id;
+  // texture buffer holding the tex_rect of every glyph slot
+  unsigned int glyph_rects_buffer_id;
+  unsigned int glyph_rects_texture_id;
+
+  // applied to the text drawn after set_text_outline(), in the units of the
+  // outlineWidth uniform
+  float outline_width;
+  Color outline_color;
 } ZephrFont;
 
 typedef struct TextInstance {
@@ -23,15 +85,54 @@ typedef struct TextInstance {
   float model[4][4];
 } GlyphInstance;
 
+// the data of the list is allocated from the frame arena and is only valid
+// until the end of the frame
 typedef struct GlyphInstanceList {
   GlyphInstance *data;
   int size;
   int capacity;
 } GlyphInstanceList;
 
+typedef struct LayoutGlyph {
+  Vec4f position;
+  int tex_coords_index;
+} LayoutGlyph;
+
+// the measured size and glyph positions of a string at the atlas pixel size.
+// the font size is applied later through the model matrix, so one layout is
+// shared by every font size the string is drawn at
+typedef struct TextLayout {
+  u64 hash;
+  char *text;
+  int text_length;
+  int text_capacity;
+  Sizef size;
+  LayoutGlyph *glyphs;
+  int glyphs_count;
+  int glyphs_capacity;
+  u64 last_used;
+  // the glyph slots are only valid for the font generation they were laid out in
+  u32 font_generation;
+} TextLayout;
+
 void new_glyph_instance_list(GlyphInstanceList *list, u32 capacity);
-int init_fonts(const char *font_path);
+// loads the font and rasterises the up front glyphs into the atlas in
+// memory, in zephr_ctx.font.render_mode. it makes no gl calls so it can run
+// on another thread before there's a context. returns -1 if freetype can't be
+// initialised and -2 if the font can't be loaded
+int load_fonts(const char *font_path);
+// creates the shader and buffers text is drawn with
+void init_text(void);
+// creates the textures of the atlas load_fonts() built and uploads it. a
+// baked atlas that is too big for the gpu is rasterised again. returns -3 if
+// not even the initial atlas fits
+int init_fonts(void);
+void deinit_fonts(void);
+void set_text_outline(float width, const Color *color);
+TextLayout *get_text_layout(const char *text);
 Sizef calculate_text_size(const char *text, int font_size);
 void draw_text(const char* text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment);
 void add_text_instance(GlyphInstanceList *batch, const char* text, int font_size, UIConstraints constraints, const Color *color, Alignment alignment);
 void draw_text_batch(GlyphInstanceList *batch);
+// draws the glyphs right away with a single instanced draw call
+void draw_glyph_instances(const GlyphInstance *instances, int instances_count, float outline_width, const Color *outline_color);
@@ -1,11 +1,18 @@
+#include <math.h>
 #include <sys/time.h>
 #include <stdlib.h>
 
 #include "timer.h"
 
 struct timeval start_time;
+// when not negative get_time() returns this instead of the wall clock. it's
+// per thread so that a snapshot can be drawn at the time it was taken while
+// the game goes on
+_Thread_local double fixed_time = -1.0;
 
 double get_time(void) {
+  if (fixed_time >= 0.0) return fixed_time;
+
   struct timeval current_time;
   gettimeofday(&current_time, NULL);
 
@@ -16,6 +23,10 @@ void start_internal_timer(void) {
   gettimeofday(&start_time, NULL);
 }
 
+void set_fixed_time(double time) {
+  fixed_time = time;
+}
+
 bool timer_ended(Timer *timer) {
   if (timer->state == TIMER_STOPPED) return false;
 
@@ -47,6 +58,13 @@ double timer_elapsed(Timer *timer) {
   return get_time() - timer->start + timer->elapsed;
 }
 
+double timer_next_second(Timer *timer) {
+  if (timer->state != TIMER_RUNNING) return -1.0;
+
+  double elapsed = timer_elapsed(timer);
+  return floor(elapsed) + 1.0 - elapsed;
+}
+
 void timer_pause(Timer *timer) {
   timer->state = TIMER_PAUSED;
   timer->elapsed = get_time() - timer->start + timer->elapsed;
@@ -17,11 +17,18 @@ typedef struct Timer {
 
 double get_time(void);
 void start_internal_timer(void);
+// makes get_time() return the given time on the calling thread, so that
+// scripted frames are deterministic. a negative time goes back to the wall clock
+void set_fixed_time(double time);
 bool timer_ended(Timer *timer);
 void timer_start(Timer *timer, float duration);
 void timer_stop(Timer *timer);
 void timer_reset(Timer *timer);
 double timer_remaining(Timer *timer);
 double timer_elapsed(Timer *timer);
+// the time until the elapsed time of a running timer reaches the next whole
+// second, which is when a clock showing it changes. negative when the timer
+// isn't running
+double timer_next_second(Timer *timer);
 void timer_pause(Timer *timer);
 void timer_resume(Timer *timer);
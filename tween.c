@@ -0,0 +1,93 @@
+#include <stddef.h>
+
+#include "tween.h"
+
+float ease(Easing easing, float t) {
+  switch (easing) {
+    case EASE_IN_QUAD:
+      return t * t;
+    case EASE_OUT_QUAD:
+      return t * (2.f - t);
+    case EASE_IN_OUT_QUAD:
+      return t < 0.5f ? 2.f * t * t : -1.f + (4.f - 2.f * t) * t;
+    case EASE_OUT_CUBIC: {
+      float u = t - 1.f;
+      return u * u * u + 1.f;
+    }
+    case EASE_OUT_BACK: {
+      const float c1 = 1.70158f;
+      const float c3 = c1 + 1.f;
+      float u = t - 1.f;
+      return 1.f + c3 * u * u * u + c1 * u * u;
+    }
+    default:
+    case EASE_LINEAR:
+      return t;
+  }
+}
+
+Tween *find_tween(TweenPool *pool, float *value) {
+  for (int i = 0; i < pool->active_count; i++) {
+    if (pool->tweens[i].value == value) return &pool->tweens[i];
+  }
+
+  return NULL;
+}
+
+void tween_start(TweenPool *pool, float *value, float to, float duration, Easing easing) {
+  Tween *tween = find_tween(pool, value);
+  if (!tween) {
+    if (pool->active_count == TWEEN_POOL_SIZE || duration <= 0.f) {
+      *value = to;
+      return;
+    }
+    tween = &pool->tweens[pool->active_count++];
+  }
+
+  *tween = (Tween){
+    .value = value,
+    .from = *value,
+    .to = to,
+    .elapsed = 0.f,
+    .duration = duration,
+    .easing = easing,
+  };
+}
+
+void tween_to(TweenPool *pool, float *value, float to, float duration, Easing easing) {
+  Tween *tween = find_tween(pool, value);
+  if (tween ? tween->to == to : *value == to) return;
+
+  tween_start(pool, value, to, duration, easing);
+}
+
+void tween_cancel(TweenPool *pool, float *value) {
+  Tween *tween = find_tween(pool, value);
+  if (tween) {
+    *tween = pool->tweens[--pool->active_count];
+  }
+}
+
+bool tween_pool_update(TweenPool *pool, float dt) {
+  bool changed = pool->active_count > 0;
+
+  int i = 0;
+  while (i < pool->active_count) {
+    Tween *tween = &pool->tweens[i];
+    tween->elapsed += dt;
+
+    if (tween->elapsed >= tween->duration) {
+      *tween->value = tween->to;
+      // the last tween takes the place of the finished one, so it's updated
+      // next without moving the rest
+      *tween = pool->tweens[--pool->active_count];
+      continue;
+    }
+
+    float t = ease(tween->easing, tween->elapsed / tween->duration);
+    *tween->value = tween->from + (tween->to - tween->from) * t;
+    i++;
+  }
+
+  return changed;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define TWEEN_POOL_SIZE 128
+
+typedef enum Easing {
+  EASE_LINEAR,
+  EASE_IN_QUAD,
+  EASE_OUT_QUAD,
+  EASE_IN_OUT_QUAD,
+  EASE_OUT_CUBIC,
+  // overshoots the target a little before settling on it
+  EASE_OUT_BACK,
+} Easing;
+
+// animates a float owned by someone else from one value to another
+typedef struct Tween {
+  float *value;
+  float from;
+  float to;
+  float elapsed;
+  float duration;
+  Easing easing;
+} Tween;
+
+// the running tweens are kept packed at the start of the array, so updating
+// them only touches the active ones and nothing is ever allocated
+typedef struct TweenPool {
+  Tween tweens[TWEEN_POOL_SIZE];
+  int active_count;
+} TweenPool;
+
+// maps t in [0, 1] onto the curve
+float ease(Easing easing, float t);
+// animates the value from where it is now to the target. a tween already
+// running on the value is retargeted instead, so interrupting an animation
+// doesn't make it jump. when the pool is full the value jumps to the target
+void tween_start(TweenPool *pool, float *value, float to, float duration, Easing easing);
+// like tween_start but does nothing when the value is already at the target
+// or on its way there, so it can be called every tick with the state the
+// value should follow
+void tween_to(TweenPool *pool, float *value, float to, float duration, Easing easing);
+// stops animating the value and leaves it where it is
+void tween_cancel(TweenPool *pool, float *value);
+// advances the running tweens by dt seconds and removes the finished ones,
+// which are left exactly at their target. returns whether any value changed
+bool tween_pool_update(TweenPool *pool, float dt);
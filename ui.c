@@ -1,42 +1,60 @@
+#include <stddef.h>
 #include <stdio.h>
 
 #include <glad/glx.h>
 
+#include "gl_stats.h"
 #include "shader.h"
+#include "stream_buffer.h"
 #include "zephr.h"
 
+#define UI_STREAM_FRAME_SIZE (1024 * 1024)
+
 Shader ui_shader;
 unsigned int ui_vao;
 unsigned int ui_vbo;
 
-int init_ui(const char* font_path, Size window_size) {
+// the fonts are loaded separately, see load_fonts() and init_fonts()
+void init_ui(Size window_size) {
   zephr_ctx.window.size = window_size;
   zephr_ctx.projection = orthographic_projection_2d(0.f, window_size.width, window_size.height, 0.f);
 
-  int res = init_fonts(font_path);
-  if (res == -1) {
-    printf("[ERROR]: could not initialize freetype library\n");
-    return 1;
-  } else if (res == -2) {
-    printf("[ERROR]: could not load font file: \"%s\"\n", font_path);
-    return 1;
-  }
+  stream_buffer_init(&zephr_ctx.instance_stream, UI_STREAM_FRAME_SIZE);
+
+  init_text();
 
   ui_shader = create_shader("shaders/ui.vert", "shaders/ui.frag");
 
+  // every shape is an instance of the unit quad, which the vertex shader
+  // scales, rotates and moves into place. the per instance attributes are
+  // streamed and pointed at the instances on every draw
+  float unit_quad[6][2] = {
+    {0.f, 1.f}, {0.f, 0.f}, {1.f, 0.f},
+    {0.f, 1.f}, {1.f, 0.f}, {1.f, 1.f},
+  };
+
   glGenVertexArrays(1, &ui_vao);
   glGenBuffers(1, &ui_vbo);
-
   glBindVertexArray(ui_vao);
+
   glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(unit_quad), unit_quad, GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+  for (u32 i = 1; i <= 4; i++) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
-  return 0;
+  use_shader(ui_shader);
+  set_mat4f(ui_shader, "projection", (float *)zephr_ctx.projection.m);
+  set_int(ui_shader, "antiAliased", zephr_ctx.anti_aliasing != ZEPHR_ANTI_ALIASING_NONE);
+
+  renderer_init(&zephr_ctx.renderer);
 }
 
 void set_x_constraint(UIConstraints *constraints, float value, UIConstraint type) {
@@ -151,107 +169,63 @@ void apply_alignment(Alignment align, Vec2f *pos, Sizef size) {
   }
 }
 
-void draw_quad(UIConstraints constraints, const Color *color, float border_radius, Alignment align) {
-  use_shader(ui_shader);
-
-  if (color) {
-    set_vec4f(ui_shader, "aColor", color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f);
-  } else {
-    set_vec4f(ui_shader, "aColor", 0.f, 0.f, 0.f, 1.f);
-  }
-
-  set_float(ui_shader, "uiWidth", constraints.width);
-  set_float(ui_shader, "uiHeight", constraints.height);
-  set_float(ui_shader, "borderRadius", border_radius);
-  set_mat4f(ui_shader, "projection", (float *)zephr_ctx.projection.m);
-
+// pushes the shape to the renderer, it's drawn when the frame is flushed
+void push_shape(UIConstraints constraints, const Color *color, float border_radius, float border_width, ShapeType shape, Alignment align) {
   Vec2f pos = { 0.f, 0.f };
   Sizef size = { 0.f, 0.f };
 
   apply_constraints(constraints, &pos, &size);
   apply_alignment(align, &pos, size);
 
-  Matrix4x4 model = identity();
-  apply_translation(&model, (Vec2f){-size.width / 2.f, -size.height / 2.f});
-  apply_rotation(&model, to_radians(constraints.rotation));
-  apply_translation(&model, (Vec2f){size.width / 2.f, size.height / 2.f});
-
-  apply_translation(&model, pos);
-
-  set_mat4f(ui_shader, "model", (float *)model.m);
-
-  glBindVertexArray(ui_vao);
-
-  float vertices[6][4] = {
-    // bottom left tri
-    {0,              0 + size.height, 0.0, 1.0},
-    {0,              0,               0.0, 0.0},
-    {0 + size.width, 0,               1.0, 0.0},
-
-    // top right tri
-    {0,              0 + size.height, 0.0, 1.0},
-    {0 + size.width, 0,               1.0, 0.0},
-    {0 + size.width, 0 + size.height, 1.0, 1.0},
+  ShapeInstance instance = {
+    .rect = { pos.x, pos.y, size.width, size.height },
+    .color = { 0.f, 0.f, 0.f, 1.f },
+    .rotation = to_radians(constraints.rotation),
+    .border_radius = border_radius,
+    .border_width = border_width,
+    .shape = shape,
   };
+  if (color) {
+    instance.color = (Color){ color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f };
+  }
 
-  glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  renderer_push_shape(&zephr_ctx.renderer, &instance);
+}
 
-  glDrawArrays(GL_TRIANGLES, 0, 6);
+void draw_quad(UIConstraints constraints, const Color *color, float border_radius, Alignment align) {
+  push_shape(constraints, color, border_radius, 0.f, SHAPE_RECT, align);
+}
 
-  glBindVertexArray(0);
+void draw_quad_border(UIConstraints constraints, const Color *color, float border_radius, float border_width, Alignment align) {
+  push_shape(constraints, color, border_radius, border_width, SHAPE_RECT, align);
 }
 
 void draw_circle(UIConstraints constraints, const Color *color, Alignment align) {
-  float radius = 0.f;
-
-  if (constraints.width > constraints.height) {
-    radius = constraints.height / 2.f;
-  } else {
-    radius = constraints.width / 2.f;
-  }
-  draw_quad(constraints, color, radius, align);
+  push_shape(constraints, color, 0.f, 0.f, SHAPE_CIRCLE, align);
 }
 
+// the triangle points down with its base along the top edge of the rect
 void draw_triangle(UIConstraints constraints, const Color *color, Alignment align) {
-  use_shader(ui_shader);
-
-  if (color) {
-    set_vec4f(ui_shader, "aColor", color->r / 255.f, color->g / 255.f, color->b / 255.f, color->a / 255.f);
-  } else {
-    set_vec4f(ui_shader, "aColor", 0.f, 0.f, 0.f, 1.f);
-  }
-  set_mat4f(ui_shader, "projection", (float *)zephr_ctx.projection.m);
-
-  Vec2f pos = { 0.f, 0.f };
-  Sizef size = { 0.f, 0.f };
-
-  apply_constraints(constraints, &pos, &size);
-  apply_alignment(align, &pos, size);
-
-  Matrix4x4 model = identity();
-  apply_translation(&model, (Vec2f){-size.width / 2.f, -size.height / 2.f});
-  apply_rotation(&model, to_radians(constraints.rotation));
-  apply_translation(&model, (Vec2f){size.width / 2.f, size.height / 2.f});
+  push_shape(constraints, color, 0.f, 0.f, SHAPE_TRIANGLE, align);
+}
 
-  apply_translation(&model, pos);
+void draw_shape_instances(const ShapeInstance *instances, int instances_count) {
+  if (instances_count == 0) return;
 
-  set_mat4f(ui_shader, "model", (float *)model.m);
+  use_shader(ui_shader);
+  // the projection changes when the window is resized
+  set_mat4f(ui_shader, "projection", (float *)zephr_ctx.projection.m);
 
   glBindVertexArray(ui_vao);
 
-  float vertices[3][4] = {
-    {0 + size.width,     0,               0.0, 0.0},
-    {0,                  0,               0.0, 0.0},
-    {0 + size.width / 2, 0 + size.height, 0.0, 0.0},
-  };
-
-  glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+  uptr offset = stream_buffer_push(&zephr_ctx.instance_stream, instances, sizeof(ShapeInstance) * instances_count, 16);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void *)offset);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void *)(offset + offsetof(ShapeInstance, color)));
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void *)(offset + offsetof(ShapeInstance, rotation)));
+  glVertexAttribIPointer(4, 1, GL_INT, sizeof(ShapeInstance), (void *)(offset + offsetof(ShapeInstance, shape)));
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances_count);
 
   glBindVertexArray(0);
 }
@@ -29,7 +29,29 @@ typedef struct UIConstraints {
   float rotation;
 } UIConstraints;
 
-int init_ui(const char* font_path, Size window_size);
+// the values are shared with the ui shader
+typedef enum ShapeType {
+  SHAPE_RECT,
+  SHAPE_CIRCLE,
+  SHAPE_TRIANGLE,
+} ShapeType;
+
+// one shape as drawn by the ui shader, which evaluates its signed distance
+// function so that any mix of shapes is drawn anti-aliased in a single call
+typedef struct ShapeInstance {
+  // x, y, width, height in pixels after the alignment was applied
+  Vec4f rect;
+  // normalised to [0, 1]
+  Color color;
+  // in radians, around the center of the rect
+  float rotation;
+  float border_radius;
+  // only the border of that width is drawn, the whole shape when 0
+  float border_width;
+  int shape;
+} ShapeInstance;
+
+void init_ui(Size window_size);
 void set_x_constraint(UIConstraints *constraints, float value, UIConstraint type);
 void set_y_constraint(UIConstraints *constraints, float value, UIConstraint type);
 void set_width_constraint(UIConstraints *constraints, float value, UIConstraint type);
@@ -38,5 +60,11 @@ void set_rotation_constraint(UIConstraints *constraints, float angle_d);
 void apply_constraints(UIConstraints constraints, Vec2f *pos, Sizef *size);
 void apply_alignment(Alignment align, Vec2f *pos, Sizef size);
 void draw_quad(UIConstraints constraints, const Color *color, float border_radius, Alignment align);
+// draws only a border of the given width on the inside of the quad
+void draw_quad_border(UIConstraints constraints, const Color *color, float border_radius, float border_width, Alignment align);
+// the circle fits in the smaller of the width and height, a non square quad
+// gives a capsule
 void draw_circle(UIConstraints constraints, const Color *color, Alignment align);
 void draw_triangle(UIConstraints constraints, const Color *color, Alignment align);
+// draws the shapes right away with a single instanced draw call
+void draw_shape_instances(const ShapeInstance *instances, int instances_count);
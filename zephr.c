@@ -1,11 +1,22 @@
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <X11/Xatom.h>
 #include <glad/glx.h>
 
 #include "audio.h"
 #include "core.h"
+#include "gl_stats.h"
+#include "startup.h"
 #include "timer.h"
 #include "ui.h"
 #include "zephr.h"
@@ -14,8 +25,31 @@ Display *x11_display;
 Window x11_window;
 Colormap x11_colormap;
 GLXContext glx_context;
+// the first glx event type, used to tell GLX_INTEL_swap_event events apart
+int x11_glx_event_base;
+// the size of the last ConfigureNotify, owned by the thread handling the events
+Size x11_configured_size;
 /* XIC x11_xic; */
 
+EGLDisplay egl_display;
+EGLContext egl_context;
+EGLSurface egl_surface;
+// written to by zephr_wake() to interrupt zephr_wait_events()
+int wake_fd = -1;
+unsigned int headless_fbo;
+unsigned int headless_color_rb;
+// drawn into instead of headless_fbo when multisampling, and resolved into it
+// before reading the frame back
+unsigned int headless_msaa_fbo;
+unsigned int headless_msaa_rb;
+
+#define ZEPHR_FRAME_ARENA_SIZE (4 * 1024 * 1024)
+// sleeps are cut short by this much and the rest is spun out, since waking up
+// from a sleep can take over a millisecond
+#define ZEPHR_SLEEP_SPIN_MS 1.0
+// the slack render late leaves between a frame being ready and its present
+#define ZEPHR_RENDER_LATE_MARGIN_MS 2.0
+
 Context zephr_ctx = {0};
 
 ///////////////////////////
@@ -477,13 +511,39 @@ ZephrKeycode x11_keysym_to_zephr_keycode_map(KeySym sym) {
 /*   } */
 /* } */
 
-void x11_resize_window(void) {
-  XWindowAttributes win_attrs;
-  XGetWindowAttributes(x11_display, x11_window, &win_attrs);
-  glViewport(0, 0, win_attrs.width, win_attrs.height);
+
+const char *zephr_anti_aliasing_name(ZephrAntiAliasing anti_aliasing) {
+  switch (anti_aliasing) {
+    case ZEPHR_ANTI_ALIASING_NONE: return "none";
+    case ZEPHR_ANTI_ALIASING_ANALYTIC: return "analytic";
+    case ZEPHR_ANTI_ALIASING_MSAA_2: return "msaa2";
+    case ZEPHR_ANTI_ALIASING_MSAA_4: return "msaa4";
+    case ZEPHR_ANTI_ALIASING_MSAA_8: return "msaa8";
+    default: return "unknown";
+  }
 }
 
-int x11_create_window(const char* title, int window_width, int window_height) {
+int zephr_anti_aliasing_samples(ZephrAntiAliasing anti_aliasing) {
+  switch (anti_aliasing) {
+    case ZEPHR_ANTI_ALIASING_MSAA_2: return 2;
+    case ZEPHR_ANTI_ALIASING_MSAA_4: return 4;
+    case ZEPHR_ANTI_ALIASING_MSAA_8: return 8;
+    default: return 0;
+  }
+}
+
+// the next best thing when the framebuffer for the anti-aliasing isn't available
+ZephrAntiAliasing anti_aliasing_fallback(ZephrAntiAliasing anti_aliasing) {
+  switch (anti_aliasing) {
+    case ZEPHR_ANTI_ALIASING_MSAA_8: return ZEPHR_ANTI_ALIASING_MSAA_4;
+    case ZEPHR_ANTI_ALIASING_MSAA_4: return ZEPHR_ANTI_ALIASING_MSAA_2;
+    default: return ZEPHR_ANTI_ALIASING_ANALYTIC;
+  }
+}
+
+int x11_create_window(const char* title, int window_width, int window_height, ZephrAntiAliasing anti_aliasing) {
+  // the events are handled on another thread than the one drawing and swapping
+  XInitThreads();
   x11_display = XOpenDisplay(NULL);
   CORE_ASSERT(x11_display, "Cannot open x11 display connection\n");
 
@@ -495,7 +555,7 @@ int x11_create_window(const char* title, int window_width, int window_height) {
 
   XSetWindowAttributes attributes;
   attributes.event_mask = ExposureMask | KeyPressMask | KeyReleaseMask |
-    StructureNotifyMask | ButtonPressMask | ButtonReleaseMask;
+    StructureNotifyMask | ButtonPressMask | ButtonReleaseMask | FocusChangeMask;
   attributes.colormap = x11_colormap;
 
   x11_window = XCreateWindow(x11_display, root, 0, 0, window_width, window_height, 0,
@@ -530,17 +590,34 @@ int x11_create_window(const char* title, int window_width, int window_height) {
   printf("[INFO] Loaded GLX %d.%d\n",
       GLAD_VERSION_MAJOR(glx_version), GLAD_VERSION_MINOR(glx_version));
 
-  GLint visual_attributes[] = {
-    GLX_RENDER_TYPE, GLX_RGBA_BIT,
-    GLX_DEPTH_SIZE, 24,
-    GLX_DOUBLEBUFFER, 1,
-    GLX_SAMPLES, 4, // MSAA
-    None
-  };
-
   int num_fbc = 0;
-  GLXFBConfig *fbc =
-    glXChooseFBConfig(x11_display, screen, visual_attributes, &num_fbc);
+  GLXFBConfig *fbc = NULL;
+  for (;;) {
+    int samples = zephr_anti_aliasing_samples(anti_aliasing);
+    GLint visual_attributes[] = {
+      GLX_RENDER_TYPE, GLX_RGBA_BIT,
+      GLX_DEPTH_SIZE, 24,
+      GLX_DOUBLEBUFFER, 1,
+      GLX_SAMPLE_BUFFERS, samples > 0,
+      GLX_SAMPLES, samples,
+      None
+    };
+
+    fbc = glXChooseFBConfig(x11_display, screen, visual_attributes, &num_fbc);
+    if (fbc && num_fbc > 0) break;
+    if (fbc) XFree(fbc);
+
+    if (samples == 0) {
+      printf("[FATAL] No suitable GLX framebuffer config\n");
+      return 1;
+    }
+
+    ZephrAntiAliasing fallback = anti_aliasing_fallback(anti_aliasing);
+    printf("[WARN] No GLX framebuffer config for %s anti-aliasing, falling back to %s\n",
+        zephr_anti_aliasing_name(anti_aliasing), zephr_anti_aliasing_name(fallback));
+    anti_aliasing = fallback;
+  }
+  zephr_ctx.anti_aliasing = anti_aliasing;
 
   GLint context_attributes[] = {
     GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
@@ -567,25 +644,29 @@ int x11_create_window(const char* title, int window_width, int window_height) {
   }
   printf("[INFO] Loaded GL %d.%d\n",
       GLAD_VERSION_MAJOR(gl_version), GLAD_VERSION_MINOR(gl_version));
+  gl_enable_debug_output();
 
   XWindowAttributes win_attrs;
   XGetWindowAttributes(x11_display, x11_window, &win_attrs);
 
-  glad_glXSwapIntervalEXT(x11_display, x11_window, 1);
   // we enable blending for text
   glEnable(GL_BLEND);
-  glEnable(GL_MULTISAMPLE);
+  if (zephr_anti_aliasing_samples(anti_aliasing) > 0) {
+    glEnable(GL_MULTISAMPLE);
+  } else {
+    glDisable(GL_MULTISAMPLE);
+  }
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glViewport(0, 0, win_attrs.width, win_attrs.height);
-  x11_resize_window();
+  x11_configured_size = (Size){ win_attrs.width, win_attrs.height };
 
   XFree(fbc);
 
   return 0;
 }
 
-int x11_init(const char* title, int window_width, int window_height) {
-  int res = x11_create_window(title, window_width, window_height);
+int x11_init(const char* title, int window_width, int window_height, ZephrAntiAliasing anti_aliasing) {
+  int res = x11_create_window(title, window_width, window_height, anti_aliasing);
 
 	/* // loads the XMODIFIERS environment variable to see what IME to use */
 	/* XSetLocaleModifiers(""); */
@@ -698,6 +779,630 @@ void x11_make_window_non_resizable(int width, int height) {
   XFree(size_hints);
 }
 
+// an interval of -1 is adaptive vsync
+bool x11_set_swap_interval(int interval) {
+  if (GLAD_GLX_EXT_swap_control) {
+    glXSwapIntervalEXT(x11_display, x11_window, interval);
+    return true;
+  }
+
+  if (GLAD_GLX_MESA_swap_control && interval >= 0) {
+    return glXSwapIntervalMESA(interval) == 0;
+  }
+
+  return false;
+}
+
+double x11_get_refresh_rate(void) {
+  if (GLAD_GLX_OML_sync_control) {
+    int32_t numerator = 0, denominator = 0;
+    if (glXGetMscRateOML(x11_display, x11_window, &numerator, &denominator) && numerator > 0 && denominator > 0) {
+      return (double)numerator / denominator;
+    }
+  }
+
+  return 60.0;
+}
+
+// picks how the present time of swapped frames is found out
+void x11_init_present_timing(void) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  int error_base = 0;
+  if (GLAD_GLX_INTEL_swap_event && glXQueryExtension(x11_display, &error_base, &x11_glx_event_base)) {
+    glXSelectEvent(x11_display, x11_window, GLX_BUFFER_SWAP_COMPLETE_INTEL_MASK);
+    latency->present_timing = ZEPHR_PRESENT_TIMING_INTEL_SWAP_EVENT;
+  } else if (GLAD_GLX_OML_sync_control) {
+    latency->present_timing = ZEPHR_PRESENT_TIMING_OML_SYNC_CONTROL;
+  } else {
+    latency->present_timing = ZEPHR_PRESENT_TIMING_NONE;
+  }
+
+  // a new window starts at 0, but the drawable could have been swapped already
+  if (GLAD_GLX_OML_sync_control) {
+    int64_t ust = 0, msc = 0, sbc = 0;
+    if (glXGetSyncValuesOML(x11_display, x11_window, &ust, &msc, &sbc)) {
+      latency->sbc = sbc;
+    }
+  }
+}
+
+////////////////////////////
+//
+// Headless
+//
+///////////////////////////
+
+bool egl_has_extension(const char *extensions, const char *name) {
+  if (!extensions) return false;
+
+  uptr length = strlen(name);
+  for (const char *ext = strstr(extensions, name); ext; ext = strstr(ext + length, name)) {
+    if ((ext == extensions || ext[-1] == ' ') && (ext[length] == ' ' || ext[length] == '\0')) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// creates an egl context without any display server. a pbuffer surface is used
+// if there's a config for one, otherwise the context is made current without
+// a surface. either way everything is drawn into headless_fbo
+int egl_init(int width, int height, ZephrAntiAliasing anti_aliasing) {
+  const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (egl_has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    egl_display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  } else {
+    egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLint major, minor;
+  if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor)) {
+    printf("[FATAL] Failed to initialize EGL\n");
+    return 1;
+  }
+  printf("[INFO] Loaded EGL %d.%d\n", major, minor);
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    printf("[FATAL] EGL doesn't support desktop OpenGL\n");
+    return 1;
+  }
+
+  EGLint config_attributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_NONE
+  };
+
+  EGLConfig config = NULL;
+  EGLint num_configs = 0;
+  eglChooseConfig(egl_display, config_attributes, &config, 1, &num_configs);
+
+  const char *display_extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+  if (num_configs == 0) {
+    if (!egl_has_extension(display_extensions, "EGL_KHR_surfaceless_context") ||
+        !egl_has_extension(display_extensions, "EGL_KHR_no_config_context")) {
+      printf("[FATAL] EGL has neither pbuffers nor surfaceless contexts\n");
+      return 1;
+    }
+    config = EGL_NO_CONFIG_KHR;
+  }
+
+  EGLint context_attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+
+  egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attributes);
+  if (egl_context == EGL_NO_CONTEXT) {
+    printf("[FATAL] Failed to create EGL context\n");
+    return 1;
+  }
+
+  egl_surface = EGL_NO_SURFACE;
+  if (config != EGL_NO_CONFIG_KHR) {
+    EGLint pbuffer_attributes[] = {
+      EGL_WIDTH, width,
+      EGL_HEIGHT, height,
+      EGL_NONE
+    };
+    egl_surface = eglCreatePbufferSurface(egl_display, config, pbuffer_attributes);
+    if (egl_surface == EGL_NO_SURFACE) {
+      printf("[FATAL] Failed to create EGL pbuffer surface\n");
+      return 1;
+    }
+  }
+
+  if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+    printf("[FATAL] Failed to make the EGL context current\n");
+    return 1;
+  }
+
+  int gl_version = gladLoadGL((GLADloadfunc)eglGetProcAddress);
+  if (!gl_version) {
+    printf("[FATAL] Failed to load GL\n");
+    return 1;
+  }
+  printf("[INFO] Loaded GL %d.%d (%s)\n",
+      GLAD_VERSION_MAJOR(gl_version), GLAD_VERSION_MINOR(gl_version),
+      egl_surface == EGL_NO_SURFACE ? "surfaceless" : "pbuffer");
+  gl_enable_debug_output();
+
+  glGenRenderbuffers(1, &headless_color_rb);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless_color_rb);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &headless_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, headless_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless_color_rb);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    printf("[FATAL] Headless framebuffer is incomplete\n");
+    return 1;
+  }
+
+  int max_samples = 0;
+  glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+  while (zephr_anti_aliasing_samples(anti_aliasing) > max_samples) {
+    ZephrAntiAliasing fallback = anti_aliasing_fallback(anti_aliasing);
+    printf("[WARN] %s anti-aliasing isn't supported, falling back to %s\n",
+        zephr_anti_aliasing_name(anti_aliasing), zephr_anti_aliasing_name(fallback));
+    anti_aliasing = fallback;
+  }
+  zephr_ctx.anti_aliasing = anti_aliasing;
+
+  int samples = zephr_anti_aliasing_samples(anti_aliasing);
+  if (samples > 0) {
+    glGenRenderbuffers(1, &headless_msaa_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_msaa_rb);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &headless_msaa_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_msaa_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless_msaa_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      printf("[FATAL] Headless multisampled framebuffer is incomplete\n");
+      return 1;
+    }
+    glEnable(GL_MULTISAMPLE);
+  }
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glViewport(0, 0, width, height);
+
+  return 0;
+}
+
+void egl_close(void) {
+  glDeleteFramebuffers(1, &headless_fbo);
+  glDeleteRenderbuffers(1, &headless_color_rb);
+  if (headless_msaa_fbo) {
+    glDeleteFramebuffers(1, &headless_msaa_fbo);
+    glDeleteRenderbuffers(1, &headless_msaa_rb);
+  }
+
+  eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (egl_surface != EGL_NO_SURFACE) {
+    eglDestroySurface(egl_display, egl_surface);
+  }
+  eglDestroyContext(egl_display, egl_context);
+  eglTerminate(egl_display);
+}
+
+////////////////////////////
+//
+// Frame Capture
+//
+///////////////////////////
+
+u32 png_crc32(u32 crc, const u8 *data, uptr size) {
+  static u32 table[256];
+  if (!table[1]) {
+    for (u32 i = 0; i < 256; i++) {
+      u32 c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  for (uptr i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void png_write_u32(FILE *file, u32 value) {
+  u8 bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+  fwrite(bytes, 1, 4, file);
+}
+
+void png_write_chunk(FILE *file, const char *type, const u8 *data, u32 size) {
+  png_write_u32(file, size);
+  fwrite(type, 1, 4, file);
+  fwrite(data, 1, size, file);
+  u32 crc = png_crc32(0, (const u8 *)type, 4);
+  crc = png_crc32(crc, data, size);
+  png_write_u32(file, crc);
+}
+
+// writes an 8-bit rgb png. the image data is deflated with stored blocks only,
+// which keeps this free of a zlib dependency at the cost of file size
+bool write_png(const char *path, const u8 *rgb, int width, int height) {
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+
+  static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  fwrite(signature, 1, sizeof(signature), file);
+
+  u8 header[13] = {
+    width >> 24, width >> 16, width >> 8, width,
+    height >> 24, height >> 16, height >> 8, height,
+    8, // bit depth
+    2, // rgb
+    0, 0, 0,
+  };
+  png_write_chunk(file, "IHDR", header, sizeof(header));
+
+  // every row is prefixed with the filter type, 0 means no filter
+  uptr row_size = (uptr)width * 3 + 1;
+  uptr raw_size = row_size * height;
+  uptr blocks_count = CORE_DIV_ROUND_UP(raw_size, 0xffff);
+  uptr zlib_size = 2 + blocks_count * 5 + raw_size + 4;
+  u8 *zlib = malloc(zlib_size);
+  if (!zlib) {
+    fclose(file);
+    return false;
+  }
+
+  u8 *out = zlib;
+  *out++ = 0x78; // deflate with a 32k window
+  *out++ = 0x01; // no compression, makes the header a multiple of 31
+
+  u32 adler_a = 1, adler_b = 0;
+  uptr raw_offset = 0;
+  for (uptr block = 0; block < blocks_count; block++) {
+    u16 block_size = (u16)CORE_MIN(raw_size - raw_offset, 0xffff);
+    *out++ = block == blocks_count - 1; // final block flag, stored block type
+    *out++ = block_size & 0xff;
+    *out++ = block_size >> 8;
+    *out++ = ~block_size & 0xff;
+    *out++ = (u16)~block_size >> 8;
+
+    for (u16 i = 0; i < block_size; i++, raw_offset++) {
+      uptr x = raw_offset % row_size;
+      uptr y = raw_offset / row_size;
+      u8 byte = x == 0 ? 0 : rgb[y * (row_size - 1) + x - 1];
+      *out++ = byte;
+      adler_a = (adler_a + byte) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+    }
+  }
+
+  u32 adler = (adler_b << 16) | adler_a;
+  *out++ = adler >> 24;
+  *out++ = adler >> 16;
+  *out++ = adler >> 8;
+  *out++ = adler;
+
+  png_write_chunk(file, "IDAT", zlib, (u32)zlib_size);
+  png_write_chunk(file, "IEND", NULL, 0);
+  free(zlib);
+
+  return fclose(file) == 0;
+}
+
+bool write_ppm(const char *path, const u8 *rgb, int width, int height) {
+  FILE *file = fopen(path, "wb");
+  if (!file) return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  fwrite(rgb, 3, (uptr)width * height, file);
+
+  return fclose(file) == 0;
+}
+
+////////////////////////////
+//
+// Frame Pacing
+//
+///////////////////////////
+
+double zephr_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void zephr_sleep_until_ms(double deadline_ms) {
+  double sleep_until_ms = deadline_ms - ZEPHR_SLEEP_SPIN_MS;
+  if (sleep_until_ms > zephr_now_ms()) {
+    struct timespec ts = {
+      .tv_sec = (time_t)(sleep_until_ms / 1000.0),
+      .tv_nsec = (long)((sleep_until_ms - (time_t)(sleep_until_ms / 1000.0) * 1000.0) * 1000000.0),
+    };
+    // the sleep is only tried again when a signal cut it short, any other
+    // error leaves the rest of the wait to the spin below
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+  }
+
+  while (zephr_now_ms() < deadline_ms) {}
+}
+
+const char *zephr_present_mode_name(ZephrPresentMode mode) {
+  switch (mode) {
+    case ZEPHR_PRESENT_MODE_VSYNC: return "vsync";
+    case ZEPHR_PRESENT_MODE_ADAPTIVE_VSYNC: return "adaptive";
+    case ZEPHR_PRESENT_MODE_UNCAPPED: return "uncapped";
+    case ZEPHR_PRESENT_MODE_CAPPED: return "capped";
+    default: return "unknown";
+  }
+}
+
+ZephrPresentMode zephr_set_present_mode(ZephrPresentMode mode, double frame_cap_hz) {
+  ZephrFramePacing *pacing = &zephr_ctx.pacing;
+
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) {
+    // there's no display to sync to
+    if (mode == ZEPHR_PRESENT_MODE_VSYNC || mode == ZEPHR_PRESENT_MODE_ADAPTIVE_VSYNC) {
+      mode = ZEPHR_PRESENT_MODE_UNCAPPED;
+    }
+  } else {
+    if (mode == ZEPHR_PRESENT_MODE_ADAPTIVE_VSYNC && !GLAD_GLX_EXT_swap_control_tear) {
+      printf("[WARN] GLX_EXT_swap_control_tear isn't supported, falling back to vsync\n");
+      mode = ZEPHR_PRESENT_MODE_VSYNC;
+    }
+
+    int interval = 0;
+    if (mode == ZEPHR_PRESENT_MODE_VSYNC) {
+      interval = 1;
+    } else if (mode == ZEPHR_PRESENT_MODE_ADAPTIVE_VSYNC) {
+      interval = -1;
+    }
+
+    if (!x11_set_swap_interval(interval)) {
+      printf("[WARN] Failed to set the swap interval to %d, no swap control extension\n", interval);
+    }
+  }
+
+  if (mode == ZEPHR_PRESENT_MODE_CAPPED && frame_cap_hz <= 0.0) {
+    printf("[WARN] Invalid frame cap %.1fHz, capping at the refresh rate\n", frame_cap_hz);
+    frame_cap_hz = pacing->refresh_hz;
+  }
+
+  pacing->mode = mode;
+  pacing->frame_cap_hz = frame_cap_hz;
+  pacing->next_present_ms = zephr_now_ms();
+
+  return mode;
+}
+
+void zephr_set_render_late(bool render_late) {
+  zephr_ctx.pacing.render_late = render_late;
+  zephr_ctx.pacing.next_present_ms = zephr_now_ms();
+}
+
+double zephr_frame_budget_ms(void) {
+  if (zephr_ctx.pacing.mode == ZEPHR_PRESENT_MODE_CAPPED) {
+    return 1000.0 / zephr_ctx.pacing.frame_cap_hz;
+  }
+
+  return 1000.0 / zephr_ctx.pacing.refresh_hz;
+}
+
+// called at the start of the frame, before any input is read
+void zephr_pacing_begin_frame(void) {
+  ZephrFramePacing *pacing = &zephr_ctx.pacing;
+
+  if (pacing->render_late && pacing->mode != ZEPHR_PRESENT_MODE_UNCAPPED) {
+    zephr_sleep_until_ms(pacing->next_present_ms - pacing->render_ms - ZEPHR_RENDER_LATE_MARGIN_MS);
+  }
+
+  pacing->frame_start_ms = zephr_now_ms();
+}
+
+void zephr_pacing_swap(void) {
+  ZephrFramePacing *pacing = &zephr_ctx.pacing;
+  double budget_ms = zephr_frame_budget_ms();
+
+  if (pacing->render_late) {
+    // the frame has to actually be done for its render time to mean anything
+    glFinish();
+    double render_ms = zephr_now_ms() - pacing->frame_start_ms;
+    pacing->render_ms = render_ms > pacing->render_ms ? render_ms : pacing->render_ms * 0.95 + render_ms * 0.05;
+  }
+
+  if (pacing->mode == ZEPHR_PRESENT_MODE_CAPPED) {
+    zephr_sleep_until_ms(pacing->next_present_ms);
+  }
+
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) {
+    // there's no swap to wait on, so wait for the frame itself to keep frame
+    // times meaningful
+    glFinish();
+  } else {
+    glXSwapBuffers(x11_display, x11_window);
+    if (pacing->render_late && pacing->mode != ZEPHR_PRESENT_MODE_CAPPED) {
+      // block until the swap is done so the next present can be predicted from it
+      glFinish();
+    }
+  }
+
+  double now = zephr_now_ms();
+  if (pacing->mode == ZEPHR_PRESENT_MODE_CAPPED) {
+    pacing->next_present_ms += budget_ms;
+    // a frame that ran over the budget starts a new schedule instead of the
+    // following frames rushing to catch up
+    if (pacing->next_present_ms < now) {
+      pacing->next_present_ms = now + budget_ms;
+    }
+  } else {
+    pacing->next_present_ms = now + budget_ms;
+  }
+}
+
+////////////////////////////
+//
+// Latency
+//
+///////////////////////////
+
+void latency_record(ZephrLatencyHistogram *histogram, double ms) {
+  ms = CORE_MAX(ms, 0.0);
+  int bucket = CORE_MIN((int)(ms / ZEPHR_LATENCY_BUCKET_MS), ZEPHR_LATENCY_BUCKETS_COUNT - 1);
+  histogram->buckets[bucket]++;
+  histogram->samples_count++;
+  histogram->total_ms += ms;
+  histogram->max_ms = CORE_MAX(histogram->max_ms, ms);
+}
+
+// the upper bound of the bucket the percentile falls in
+double latency_percentile(const ZephrLatencyHistogram *histogram, double percentile) {
+  u32 target = (u32)(histogram->samples_count * percentile);
+  u32 count = 0;
+  for (int i = 0; i < ZEPHR_LATENCY_BUCKETS_COUNT; i++) {
+    count += histogram->buckets[i];
+    if (count > target) return CORE_MIN((i + 1) * ZEPHR_LATENCY_BUCKET_MS, histogram->max_ms);
+  }
+
+  return histogram->max_ms;
+}
+
+void zephr_frame_reflects_event(const ZephrEvent *event) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  if (latency->frame_input_ms < 0.0 || event->received_ms < latency->frame_input_ms) {
+    latency->frame_input_ms = event->received_ms;
+  }
+}
+
+// records the latency of every pending frame that is presented by the given
+// swap buffer count
+void latency_on_present(i64 sbc, double present_ms) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  int presented_count = 0;
+  while (presented_count < latency->pending_count && latency->pending[presented_count].sbc <= sbc) {
+    latency_record(&latency->input_to_present, present_ms - latency->pending[presented_count].input_ms);
+    presented_count++;
+  }
+
+  latency->pending_count -= presented_count;
+  memmove(latency->pending, latency->pending + presented_count, sizeof(ZephrPendingPresent) * latency->pending_count);
+}
+
+void latency_on_swap(double swap_ms) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  latency->sbc++;
+  if (latency->frame_input_ms < 0.0) return;
+
+  latency_record(&latency->input_to_swap, swap_ms - latency->frame_input_ms);
+
+  if (latency->present_timing == ZEPHR_PRESENT_TIMING_FINISH) {
+    latency_record(&latency->input_to_present, swap_ms - latency->frame_input_ms);
+  } else if (latency->present_timing != ZEPHR_PRESENT_TIMING_NONE) {
+    // the oldest frame is given up on, its present event must have been lost
+    if (latency->pending_count == ZEPHR_LATENCY_PENDING_COUNT) {
+      latency->pending_count--;
+      memmove(latency->pending, latency->pending + 1, sizeof(ZephrPendingPresent) * latency->pending_count);
+    }
+    latency->pending[latency->pending_count++] = (ZephrPendingPresent){
+      .sbc = latency->sbc,
+      .input_ms = latency->frame_input_ms,
+    };
+  }
+
+  latency->frame_input_ms = -1.0;
+}
+
+// called on the thread handling the events. an event that doesn't fit is
+// dropped, the frames it would have presented are given up on later anyway
+void latency_push_present_event(i64 sbc, double present_ms) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  u32 head = atomic_load_explicit(&latency->present_events_head, memory_order_relaxed);
+  u32 tail = atomic_load_explicit(&latency->present_events_tail, memory_order_acquire);
+  if (head - tail == ZEPHR_LATENCY_PENDING_COUNT) return;
+
+  latency->present_events[head % ZEPHR_LATENCY_PENDING_COUNT] = (ZephrPresentEvent){ sbc, present_ms };
+  atomic_store_explicit(&latency->present_events_head, head + 1, memory_order_release);
+}
+
+// the ust of glx is in microseconds on CLOCK_MONOTONIC with mesa and the
+// proprietary nvidia driver, so it's directly comparable with zephr_now_ms()
+void latency_poll_presents(void) {
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  u32 tail = atomic_load_explicit(&latency->present_events_tail, memory_order_relaxed);
+  u32 head = atomic_load_explicit(&latency->present_events_head, memory_order_acquire);
+  for (; tail != head; tail++) {
+    ZephrPresentEvent event = latency->present_events[tail % ZEPHR_LATENCY_PENDING_COUNT];
+    latency_on_present(event.sbc, event.present_ms);
+  }
+  atomic_store_explicit(&latency->present_events_tail, tail, memory_order_release);
+
+  if (latency->present_timing != ZEPHR_PRESENT_TIMING_OML_SYNC_CONTROL || latency->pending_count == 0) return;
+
+  int64_t ust = 0, msc = 0, sbc = 0;
+  if (glXGetSyncValuesOML(x11_display, x11_window, &ust, &msc, &sbc)) {
+    latency_on_present(sbc, ust / 1000.0);
+  }
+}
+
+void print_latency_histogram(const char *name, const ZephrLatencyHistogram *histogram) {
+  if (histogram->samples_count == 0) {
+    printf("  %-18s no samples\n", name);
+    return;
+  }
+
+  printf("  %-18s %6u %8.2f %8.2f %8.2f %8.2f %8.2f\n", name, histogram->samples_count,
+      histogram->total_ms / histogram->samples_count,
+      latency_percentile(histogram, 0.5),
+      latency_percentile(histogram, 0.9),
+      latency_percentile(histogram, 0.99),
+      histogram->max_ms);
+}
+
+void zephr_print_latency_report(void) {
+  const char *timings[] = { "none", "GLX_INTEL_swap_event", "GLX_OML_sync_control", "glFinish" };
+  ZephrLatency *latency = &zephr_ctx.latency;
+
+  printf("[INFO] Input latency (ms), present times from %s\n", timings[latency->present_timing]);
+  printf("  %-18s %6s %8s %8s %8s %8s %8s\n", "", "count", "avg", "p50", "p90", "p99", "max");
+  print_latency_histogram("input to swap", &latency->input_to_swap);
+  print_latency_histogram("input to present", &latency->input_to_present);
+}
+
+bool zephr_export_latency(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    printf("[ERROR] Failed to open %s to export the latency\n", path);
+    return false;
+  }
+
+  ZephrLatency *latency = &zephr_ctx.latency;
+  fprintf(file, "bucket_start_ms,input_to_swap,input_to_present\n");
+  for (int i = 0; i < ZEPHR_LATENCY_BUCKETS_COUNT; i++) {
+    fprintf(file, "%.2f,%u,%u\n", i * ZEPHR_LATENCY_BUCKET_MS,
+        latency->input_to_swap.buckets[i], latency->input_to_present.buckets[i]);
+  }
+
+  return fclose(file) == 0;
+}
+
 ////////////////////////////
 //
 // Zephr
@@ -705,45 +1410,202 @@ void x11_make_window_non_resizable(int width, int height) {
 ///////////////////////////
 
 
-u32 init_zephr(const char* font_path, const char* window_title, Size window_size) {
-  int res = audio_init();
+int audio_task(void *arg) {
+  return audio_init(*(bool *)arg);
+}
+
+int fonts_task(void *arg) {
+  return load_fonts(arg);
+}
+
+u32 init_zephr(const char* font_path, FontRenderMode font_render_mode, const char* window_title, Size window_size, ZephrBackend backend, ZephrAntiAliasing anti_aliasing) {
+  zephr_ctx.backend = backend;
+  zephr_ctx.font.render_mode = font_render_mode;
+
+  // what doesn't need the context runs on workers while the window and the
+  // context are created, and is waited for right before it's needed
+  bool is_silent = backend == ZEPHR_BACKEND_HEADLESS;
+  StartupTask audio_init_task = { .name = "audio", .run = audio_task, .arg = &is_silent };
+  StartupTask fonts_load_task = { .name = "fonts", .run = fonts_task, .arg = (void *)font_path };
+  startup_task_start(&audio_init_task);
+  startup_task_start(&fonts_load_task);
+
+  double start_ms = startup_now_ms();
+  int res;
+  if (backend == ZEPHR_BACKEND_HEADLESS) {
+    res = egl_init(window_size.width, window_size.height, anti_aliasing);
+  } else {
+    res = x11_init(window_title, window_size.width, window_size.height, anti_aliasing);
+  }
+  startup_trace_span("window", start_ms);
   if (res != 0) {
-    printf("[ERROR]: failed to initialize audio\n");
+    startup_task_wait(&fonts_load_task);
+    startup_task_wait(&audio_init_task);
     return 1;
   }
+  printf("[INFO] Anti-aliasing: %s\n", zephr_anti_aliasing_name(zephr_ctx.anti_aliasing));
 
-  res = x11_init(window_title, window_size.width, window_size.height);
-  if (res < 0) return 1;
+  core_arena_init(&zephr_ctx.frame_arena, ZEPHR_FRAME_ARENA_SIZE);
+  zephr_ctx.input_batch = 1;
 
-  res = init_ui(font_path, (Size){ .width = window_size.width, .height = window_size.height });
-  if (res != 0) {
-    printf("[ERROR]: failed to initialize ui\n");
+  wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wake_fd < 0) {
+    printf("[ERROR]: failed to create the wake eventfd\n");
+    startup_task_wait(&fonts_load_task);
+    startup_task_wait(&audio_init_task);
+    return 1;
+  }
+
+  // compiles the shaders, which doesn't need the fonts yet
+  start_ms = startup_now_ms();
+  init_ui((Size){ .width = window_size.width, .height = window_size.height });
+  startup_trace_span("ui", start_ms);
+
+  res = startup_task_wait(&fonts_load_task);
+  if (res == 0) {
+    start_ms = startup_now_ms();
+    res = init_fonts();
+    startup_trace_span("font upload", start_ms);
+  }
+  int audio_res = startup_task_wait(&audio_init_task);
+
+  if (res == -1) {
+    printf("[ERROR]: could not initialize freetype library\n");
+    return 1;
+  } else if (res == -2) {
+    printf("[ERROR]: could not load font file: \"%s\"\n", font_path);
+    return 1;
+  } else if (res == -3) {
+    printf("[ERROR]: the font atlas is too big for the gpu\n");
+    return 1;
+  }
+  if (audio_res != 0) {
+    printf("[ERROR]: failed to initialize audio\n");
     return 1;
   }
 
-  x11_get_screen_size(&zephr_ctx.screen_size.width, &zephr_ctx.screen_size.height);
+  if (backend == ZEPHR_BACKEND_HEADLESS) {
+    zephr_ctx.screen_size = window_size;
+    zephr_ctx.pacing.refresh_hz = 60.0;
+  } else {
+    x11_get_screen_size(&zephr_ctx.screen_size.width, &zephr_ctx.screen_size.height);
+    zephr_ctx.pacing.refresh_hz = x11_get_refresh_rate();
+  }
+  zephr_set_present_mode(ZEPHR_PRESENT_MODE_VSYNC, 0.0);
+
+  zephr_ctx.latency.frame_input_ms = -1.0;
+  if (backend == ZEPHR_BACKEND_HEADLESS) {
+    zephr_ctx.latency.present_timing = ZEPHR_PRESENT_TIMING_FINISH;
+  } else {
+    x11_init_present_timing();
+  }
   start_internal_timer();
 
   return 0;
 }
 
 void deinit_zephr(void) {
-  x11_close();
+  renderer_deinit(&zephr_ctx.renderer);
+  deinit_fonts();
+  stream_buffer_deinit(&zephr_ctx.instance_stream);
+  core_arena_deinit(&zephr_ctx.frame_arena);
+  close(wake_fd);
+
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) {
+    egl_close();
+  } else {
+    x11_close();
+  }
   audio_close();
 }
 
 bool zephr_should_quit(void) {
-  glClearColor(0, 0, 0, 1);
-  glClear(GL_COLOR_BUFFER_BIT);
+  zephr_begin_frame();
+
+  return zephr_update();
+}
+
+// any glx call that talks to the server, like the swap or the sync value and
+// buffer age queries, can read events from the connection into xlib's queue.
+// the event thread waiting on the connection doesn't see those, so it has to
+// be woken up to handle them
+void x11_wake_for_queued_events(void) {
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) return;
+
+  if (XEventsQueued(x11_display, QueuedAlready) > 0) {
+    zephr_wake();
+  }
+}
+
+void zephr_begin_frame(void) {
+  zephr_pacing_begin_frame();
+  latency_poll_presents();
+
+  // the frame is cleared by the first flush, once the damage is known
+  renderer_begin_frame(&zephr_ctx.renderer, zephr_buffer_age());
+  x11_wake_for_queued_events();
+}
+
+int zephr_buffer_age(void) {
+  // the offscreen framebuffer is never swapped, it always holds the last frame
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) return 1;
+  if (!GLAD_GLX_EXT_buffer_age) return 0;
+
+  unsigned int age = 0;
+  glXQueryDrawable(x11_display, x11_window, GLX_BACK_BUFFER_AGE_EXT, &age);
+  return (int)age;
+}
 
+bool zephr_update(void) {
   audio_update();
 
   return zephr_ctx.should_quit;
 }
 
+void zephr_make_context_current(bool current) {
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) {
+    if (current) {
+      eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context);
+    } else {
+      eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+  } else {
+    if (current) {
+      glXMakeCurrent(x11_display, x11_window, glx_context);
+    } else {
+      glXMakeCurrent(x11_display, None, NULL);
+    }
+  }
+}
+
+void zephr_resize(Size size) {
+  if (size.width == zephr_ctx.window.size.width && size.height == zephr_ctx.window.size.height) return;
+
+  zephr_ctx.window.size = size;
+  zephr_ctx.projection = orthographic_projection_2d(0.f, (float)size.width, (float)size.height, 0.f);
+  glViewport(0, 0, size.width, size.height);
+}
+
 // This MUST be called at the end of the frame
 void zephr_swap_buffers(void) {
-  glXSwapBuffers(x11_display, x11_window);
+  zephr_flush_draws();
+  renderer_end_frame(&zephr_ctx.renderer);
+  zephr_pacing_swap();
+  latency_on_swap(zephr_now_ms());
+  x11_wake_for_queued_events();
+
+  stream_buffer_end_frame(&zephr_ctx.instance_stream);
+  gl_stats_end_frame();
+  core_arena_reset(&zephr_ctx.frame_arena);
+  // glyphs that were last used before this frame can be evicted from the atlas
+  zephr_ctx.font.frame++;
+}
+
+void zephr_flush_draws(void) {
+  // an empty frame is still flushed once, to clear it
+  if (zephr_ctx.renderer.commands_count == 0 && !zephr_ctx.renderer.is_frame_pending) return;
+
+  renderer_flush(&zephr_ctx.renderer);
 }
 
 Size zephr_get_window_size(void) {
@@ -752,10 +1614,14 @@ Size zephr_get_window_size(void) {
 
 // This MUST be called after calling init_zephr()
 void zephr_make_window_non_resizable(void) {
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) return;
+
   x11_make_window_non_resizable(zephr_ctx.window.size.width, zephr_ctx.window.size.height);
 }
 
 void zephr_toggle_fullscreen(void) {
+  if (zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS) return;
+
   x11_toggle_fullscreen(zephr_ctx.window.is_fullscreen);
 
   zephr_ctx.window.is_fullscreen = !zephr_ctx.window.is_fullscreen;
@@ -763,6 +1629,34 @@ void zephr_toggle_fullscreen(void) {
 
 void zephr_quit(void) {
   zephr_ctx.should_quit = true;
+  zephr_wake();
+}
+
+void zephr_wake(void) {
+  u64 one = 1;
+  ssize_t written = write(wake_fd, &one, sizeof(one));
+  // the counter only fails to grow when it's already about to overflow, in
+  // which case the wait returns anyway
+  CORE_UNUSED(written);
+}
+
+void zephr_wait_events(double timeout_ms) {
+  // the events another thread read from the connection, e.g. while swapping,
+  // are already queued and won't make the connection readable
+  if (zephr_ctx.backend != ZEPHR_BACKEND_HEADLESS && XEventsQueued(x11_display, QueuedAfterFlush) > 0) return;
+
+  struct pollfd fds[2] = {
+    { .fd = wake_fd, .events = POLLIN },
+    { .fd = zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS ? -1 : ConnectionNumber(x11_display), .events = POLLIN },
+  };
+  int timeout = timeout_ms < 0.0 ? -1 : (int)ceil(timeout_ms);
+  poll(fds, 2, timeout);
+
+  if (fds[0].revents & POLLIN) {
+    u64 wakes_count;
+    ssize_t read_size = read(wake_fd, &wakes_count, sizeof(wakes_count));
+    CORE_UNUSED(read_size);
+  }
 }
 
 ZephrKeyMod zephr_x11_mods_to_zephr_mods(XKeyEvent xkey) {
@@ -814,62 +1708,74 @@ ZephrKeyMod zephr_x11_mods_to_zephr_mods(XKeyEvent xkey) {
   return zephr_mods;
 }
 
-bool zephr_iter_events(ZephrEvent *event_out) {
-  XEvent xev;
-
-  while (XPending(x11_display)) {
-    XNextEvent(x11_display, &xev);
+// translates the x event into event_out, returns false if there's nothing in
+// it for the app
+bool x11_translate_event(XEvent xev, ZephrEvent *event_out) {
+  *event_out = (ZephrEvent){0};
+  event_out->received_ms = zephr_now_ms();
 
-    if (xev.type == ConfigureNotify) {
-      XConfigureEvent xce = xev.xconfigure;
+  if (x11_glx_event_base && xev.type == x11_glx_event_base + GLX_BufferSwapComplete) {
+    GLXBufferSwapComplete *swap_complete = (GLXBufferSwapComplete *)&xev;
+    latency_push_present_event(swap_complete->sbc, swap_complete->ust / 1000.0);
+  } else if (xev.type == ConfigureNotify) {
+    XConfigureEvent xce = xev.xconfigure;
 
-      if (xce.width != zephr_ctx.window.size.width || xce.height != zephr_ctx.window.size.height) {
-        zephr_ctx.window.size = (Size){ .width = xce.width, .height = xce.height };
-        zephr_ctx.projection = orthographic_projection_2d(0.f, xce.width, xce.height, 0.f);
-        x11_resize_window();
+    // the window size used for drawing is only changed by zephr_resize()
+    // since the thread drawing might not be this one
+    if (xce.width != x11_configured_size.width || xce.height != x11_configured_size.height) {
+      x11_configured_size = (Size){ .width = xce.width, .height = xce.height };
 
-        event_out->type = ZEPHR_EVENT_WINDOW_RESIZED;
-        event_out->window.width = xce.width;
-        event_out->window.height = xce.height;
+      event_out->type = ZEPHR_EVENT_WINDOW_RESIZED;
+      event_out->window.width = xce.width;
+      event_out->window.height = xce.height;
 
-        return true;
-      }
-    } else if (xev.type == DestroyNotify) {
-      // window destroy event
+      return true;
+    }
+  } else if (xev.type == Expose) {
+    // only the last of a series of exposes is reported, the whole frame is
+    // drawn again anyway
+    if (xev.xexpose.count == 0) {
+      event_out->type = ZEPHR_EVENT_WINDOW_EXPOSED;
+      return true;
+    }
+  } else if (xev.type == DestroyNotify) {
+    // window destroy event
+    event_out->type = ZEPHR_EVENT_WINDOW_CLOSED;
+    return true;
+  } else if (xev.type == ClientMessage) {
+    // window close event
+    if ((Atom)xev.xclient.data.l[0] == zephr_ctx.window_delete_atom) {
       event_out->type = ZEPHR_EVENT_WINDOW_CLOSED;
       return true;
-    } else if (xev.type == ClientMessage) {
-      // window close event
-      if ((Atom)xev.xclient.data.l[0] == zephr_ctx.window_delete_atom) {
-        event_out->type = ZEPHR_EVENT_WINDOW_CLOSED;
-        return true;
-      }
-    } else if (xev.type == KeyPress) {
-      XKeyEvent xke = xev.xkey;
+    }
+  } else if (xev.type == KeyPress) {
+    XKeyEvent xke = xev.xkey;
 
-      u32 evdev_keycode = xke.keycode - 8;
-      ZephrScancode scancode = zephr_evdev_scancode_to_zephr_scancode_map[evdev_keycode];
+    u32 evdev_keycode = xke.keycode - 8;
+    ZephrScancode scancode = zephr_evdev_scancode_to_zephr_scancode_map[evdev_keycode];
 
-      event_out->type = ZEPHR_EVENT_KEY_PRESSED;
-      event_out->key.code = scancode;
-      event_out->key.mods = zephr_x11_mods_to_zephr_mods(xke);
+    event_out->type = ZEPHR_EVENT_KEY_PRESSED;
+    event_out->server_time = (u32)xke.time;
+    event_out->key.is_pressed = true;
+    event_out->key.code = scancode;
+    event_out->key.mods = zephr_x11_mods_to_zephr_mods(xke);
 
-      /* { */
-      /*   // remove the control modifier as it causes control codes to be returned */
-      /*   xev.xkey.state &= ~ControlMask; */
+    /* { */
+    /*   // remove the control modifier as it causes control codes to be returned */
+    /*   xev.xkey.state &= ~ControlMask; */
 
-      /*   char string[4] = {0}; */
-      /*   KeySym keysym = 0; */
-      /*   u8 string_length = Xutf8LookupString(x11_xic, &xev.xkey, string, sizeof(string), &keysym, NULL); */
+    /*   char string[4] = {0}; */
+    /*   KeySym keysym = 0; */
+    /*   u8 string_length = Xutf8LookupString(x11_xic, &xev.xkey, string, sizeof(string), &keysym, NULL); */
 
 				/* // do not send any keys like ctrl, shift, function, arrow, escape, return, backspace. */
 				/* // instead, send regular key events. */
 				/* if (string_length && !(keysym >= 0xfd00 && keysym <= 0xffff)) { */
 					/* os_event_queue_virt_key_input_utf8(string, string_length); */
 				/* } */
-      /* } */
+    /* } */
 
-      /* // an X11 keycode is conceptually the same as our keycode. */
+    /* // an X11 keycode is conceptually the same as our keycode. */
 			/* // they are both used to represent a physical key. */
 			/* // map evdev enumeration to our keycode */
 			/* u32 evdev_keycode = xev.xkey.keycode - 8; */
@@ -881,84 +1787,237 @@ bool zephr_iter_events(ZephrEvent *event_out) {
 			/* } */
 			/* os_event_queue_virt_key_changed(xev.type == KeyPress, keycode); */
 
-      return true;
-    } else if (xev.type == KeyRelease) {
-      XKeyEvent xke = xev.xkey;
+    return true;
+  } else if (xev.type == KeyRelease) {
+    XKeyEvent xke = xev.xkey;
 
-      unsigned int evdev_keycode = xke.keycode - 8;
-      ZephrScancode scancode = zephr_evdev_scancode_to_zephr_scancode_map[evdev_keycode];
+    unsigned int evdev_keycode = xke.keycode - 8;
+    ZephrScancode scancode = zephr_evdev_scancode_to_zephr_scancode_map[evdev_keycode];
 
-      event_out->type = ZEPHR_EVENT_KEY_RELEASED;
-      event_out->key.code = scancode;
-      event_out->key.mods = zephr_x11_mods_to_zephr_mods(xke);
+    event_out->type = ZEPHR_EVENT_KEY_RELEASED;
+    event_out->server_time = (u32)xke.time;
+    event_out->key.code = scancode;
+    event_out->key.mods = zephr_x11_mods_to_zephr_mods(xke);
 
-      return true;
-      
-    } else if (xev.type == ButtonPress) {
-      event_out->type = ZEPHR_EVENT_MOUSE_BUTTON_PRESSED;
-      event_out->mouse.position = (Vec2){ .x = xev.xbutton.x, .y = xev.xbutton.y };
-
-      switch (xev.xbutton.button) {
-        case Button1:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_LEFT;
-          break;
-        case Button2:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_MIDDLE;
-          break;
-        case Button3:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_RIGHT;
-          break;
-        case Button4:
-          event_out->type = ZEPHR_EVENT_MOUSE_SCROLL;
-          event_out->mouse.scroll_direction = ZEPHR_MOUSE_SCROLL_UP;
-          break;
-        case Button5:
-          event_out->type = ZEPHR_EVENT_MOUSE_SCROLL;
-          event_out->mouse.scroll_direction = ZEPHR_MOUSE_SCROLL_DOWN;
-          break;
-        case 8: // Back
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_BACK;
-          break;
-        case 9: // Forward
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_FORWARD;
-          break;
-        default:
-          printf("[WARN] Unknown mouse button pressed: %d\n", xev.xbutton.button);
-          break;
-      }
-      
-      return true;
-    } else if (xev.type == ButtonRelease) {
-      event_out->type = ZEPHR_EVENT_MOUSE_BUTTON_RELEASED;
-      event_out->mouse.position = (Vec2){ .x = xev.xbutton.x, .y = xev.xbutton.y };
-
-      switch (xev.xbutton.button) {
-        case Button1:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_LEFT;
-          break;
-        case Button2:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_MIDDLE;
-          break;
-        case Button3:
-          event_out->mouse.button = ZEPHR_MOUSE_BUTTON_RIGHT;
-          break;
-      }
+    return true;
+    
+  } else if (xev.type == ButtonPress) {
+    event_out->type = ZEPHR_EVENT_MOUSE_BUTTON_PRESSED;
+    event_out->server_time = (u32)xev.xbutton.time;
+    event_out->mouse.position = (Vec2){ .x = xev.xbutton.x, .y = xev.xbutton.y };
 
-      return true;
-    } else if (xev.type == MappingNotify) {
-      // input device mapping changed
-      if (xev.xmapping.request != MappingKeyboard) {
+    switch (xev.xbutton.button) {
+      case Button1:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_LEFT;
         break;
-      }
+      case Button2:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_MIDDLE;
+        break;
+      case Button3:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_RIGHT;
+        break;
+      case Button4:
+        event_out->type = ZEPHR_EVENT_MOUSE_SCROLL;
+        event_out->mouse.scroll_direction = ZEPHR_MOUSE_SCROLL_UP;
+        break;
+      case Button5:
+        event_out->type = ZEPHR_EVENT_MOUSE_SCROLL;
+        event_out->mouse.scroll_direction = ZEPHR_MOUSE_SCROLL_DOWN;
+        break;
+      case 8: // Back
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_BACK;
+        break;
+      case 9: // Forward
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_FORWARD;
+        break;
+      default:
+        printf("[WARN] Unknown mouse button pressed: %d\n", xev.xbutton.button);
+        return false;
+    }
+    
+    return true;
+  } else if (xev.type == ButtonRelease) {
+    event_out->type = ZEPHR_EVENT_MOUSE_BUTTON_RELEASED;
+    event_out->server_time = (u32)xev.xbutton.time;
+    event_out->mouse.position = (Vec2){ .x = xev.xbutton.x, .y = xev.xbutton.y };
+
+    switch (xev.xbutton.button) {
+      case Button1:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_LEFT;
+        break;
+      case Button2:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_MIDDLE;
+        break;
+      case Button3:
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_RIGHT;
+        break;
+      case 8: // Back
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_BACK;
+        break;
+      case 9: // Forward
+        event_out->mouse.button = ZEPHR_MOUSE_BUTTON_FORWARD;
+        break;
+      default:
+        // the scroll wheel releases and unknown buttons
+        return false;
+    }
+
+    return true;
+  } else if (xev.type == FocusOut) {
+    // focus moving between the window and its children isn't the window
+    // losing it
+    if (xev.xfocus.detail != NotifyInferior) {
+      event_out->type = ZEPHR_EVENT_WINDOW_FOCUS_LOST;
+      return true;
+    }
+  } else if (xev.type == MappingNotify) {
+    // input device mapping changed
+    if (xev.xmapping.request == MappingKeyboard) {
       XRefreshKeyboardMapping(&xev.xmapping);
       /* x11_keyboard_map_update(); */
-      break;
     }
   }
 
   return false;
 }
 
+// moves on to the next batch, which leaves what changed in the last one behind
+// without touching the per key stamps
+void input_begin_batch(void) {
+  zephr_ctx.input_batch++;
+}
+
+void input_apply_event(const ZephrEvent *event) {
+  ZephrKeyboard *keyboard = &zephr_ctx.keyboard;
+  ZephrMouse *mouse = &zephr_ctx.mouse;
+  u64 batch = zephr_ctx.input_batch;
+
+  switch (event->type) {
+    case ZEPHR_EVENT_KEY_PRESSED:
+      if (event->key.code >= ZEPHR_KEYBOARD_KEYS_COUNT || event->key.is_repeat) break;
+      core_bitset_set(keyboard->keycode_is_pressed_bitset, event->key.code);
+      keyboard->keycode_pressed_batch[event->key.code] = batch;
+      break;
+    case ZEPHR_EVENT_KEY_RELEASED:
+      if (event->key.code >= ZEPHR_KEYBOARD_KEYS_COUNT) break;
+      core_bitset_unset(keyboard->keycode_is_pressed_bitset, event->key.code);
+      keyboard->keycode_released_batch[event->key.code] = batch;
+      break;
+    case ZEPHR_EVENT_MOUSE_BUTTON_PRESSED:
+      core_bitset_set(mouse->button_is_pressed_bitset, event->mouse.button);
+      mouse->button_pressed_batch[event->mouse.button] = batch;
+      break;
+    case ZEPHR_EVENT_MOUSE_BUTTON_RELEASED:
+      core_bitset_unset(mouse->button_is_pressed_bitset, event->mouse.button);
+      mouse->button_released_batch[event->mouse.button] = batch;
+      break;
+    case ZEPHR_EVENT_WINDOW_FOCUS_LOST:
+      // whatever is held down is released as far as the app can tell
+      for (u32 i = 0; i < ZEPHR_KEYBOARD_KEYS_COUNT; i++) {
+        if (core_bitset_is_set(keyboard->keycode_is_pressed_bitset, i)) {
+          core_bitset_unset(keyboard->keycode_is_pressed_bitset, i);
+          keyboard->keycode_released_batch[i] = batch;
+        }
+      }
+      for (u32 i = 0; i < ZEPHR_MOUSE_BUTTON_COUNT; i++) {
+        if (core_bitset_is_set(mouse->button_is_pressed_bitset, i)) {
+          core_bitset_unset(mouse->button_is_pressed_bitset, i);
+          mouse->button_released_batch[i] = batch;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void zephr_push_event(const ZephrEvent *event) {
+  ZephrEventQueue *queue = &zephr_ctx.event_queue;
+
+  if (queue->count > 0) {
+    ZephrEvent *last = &queue->events[(queue->head + queue->count - 1) % ZEPHR_EVENT_QUEUE_CAPACITY];
+
+    // only the latest size matters and one redraw covers any number of exposes
+    if (event->type == last->type && (event->type == ZEPHR_EVENT_WINDOW_RESIZED || event->type == ZEPHR_EVENT_WINDOW_EXPOSED)) {
+      *last = *event;
+      return;
+    }
+  }
+
+  if (queue->count == ZEPHR_EVENT_QUEUE_CAPACITY) {
+    printf("[WARN] Event queue is full, dropping the oldest event\n");
+    queue->head = (queue->head + 1) % ZEPHR_EVENT_QUEUE_CAPACITY;
+    queue->count--;
+  }
+
+  queue->events[(queue->head + queue->count) % ZEPHR_EVENT_QUEUE_CAPACITY] = *event;
+  queue->count++;
+}
+
+u32 zephr_poll_events(const ZephrEvent **events_out) {
+  ZephrEventQueue *queue = &zephr_ctx.event_queue;
+
+  if (zephr_ctx.backend != ZEPHR_BACKEND_HEADLESS) {
+    // only the events there are now are read, the ones arriving meanwhile
+    // wait for the next frame. what doesn't fit in the queue waits too
+    int pending = XEventsQueued(x11_display, QueuedAfterReading);
+    XEvent xev;
+    XEvent next_xev;
+    ZephrEvent event;
+
+    while (pending > 0 && queue->count < ZEPHR_EVENT_QUEUE_CAPACITY) {
+      XNextEvent(x11_display, &xev);
+      pending--;
+
+      bool is_repeat = false;
+      if (xev.type == ConfigureNotify) {
+        // a window being dragged to size sends a stream of these, only the
+        // last one is of any use
+        while (pending > 0) {
+          XPeekEvent(x11_display, &next_xev);
+          if (next_xev.type != ConfigureNotify) break;
+          XNextEvent(x11_display, &xev);
+          pending--;
+        }
+      } else if (xev.type == KeyRelease && pending > 0) {
+        // x reports an auto-repeat as a release immediately followed by a
+        // press of the same key at the same time
+        XPeekEvent(x11_display, &next_xev);
+        if (next_xev.type == KeyPress && next_xev.xkey.keycode == xev.xkey.keycode && next_xev.xkey.time == xev.xkey.time) {
+          XNextEvent(x11_display, &xev);
+          pending--;
+          is_repeat = true;
+        }
+      }
+
+      if (x11_translate_event(xev, &event)) {
+        if (event.type == ZEPHR_EVENT_KEY_PRESSED) {
+          event.key.is_repeat = is_repeat;
+        }
+        zephr_push_event(&event);
+      }
+    }
+  }
+
+  // the input state is brought up to date with the events as they're handed
+  // out, so it always agrees with them
+  input_begin_batch();
+
+  // the ring is handed out as one array so the app can go through it in a
+  // plain loop
+  u32 events_count = queue->count;
+  for (u32 i = 0; i < events_count; i++) {
+    zephr_ctx.frame_events[i] = queue->events[(queue->head + i) % ZEPHR_EVENT_QUEUE_CAPACITY];
+    input_apply_event(&zephr_ctx.frame_events[i]);
+  }
+  queue->head = 0;
+  queue->count = 0;
+
+  *events_out = zephr_ctx.frame_events;
+  return events_count;
+}
+
+
 /* bool zephr_keyboard_scancode_is_pressed(ZephrScancode scancode) { */
 /*   return core_bitset_is_set(zephr_ctx.keyboard.scancode_is_pressed_bitset, scancode); */
 /* } */
@@ -972,18 +2031,32 @@ bool zephr_iter_events(ZephrEvent *event_out) {
 /* } */
 
 
-/* bool zephr_keyboard_keycode_is_pressed(ZephrKeycode keycode) { */
-/*   return core_bitset_is_set(zephr_ctx.keyboard.keycode_is_pressed_bitset, keycode); */
-/* } */
+bool zephr_keyboard_keycode_is_pressed(ZephrKeycode keycode) {
+  if (keycode >= ZEPHR_KEYBOARD_KEYS_COUNT) return false;
+  return core_bitset_is_set(zephr_ctx.keyboard.keycode_is_pressed_bitset, keycode);
+}
 
-/* bool zephr_keyboard_keycode_has_been_pressed(ZephrKeycode keycode) { */
-/*   return core_bitset_is_set(zephr_ctx.keyboard.keycode_has_been_pressed_bitset, keycode); */
-/* } */
+bool zephr_keyboard_keycode_has_been_pressed(ZephrKeycode keycode) {
+  if (keycode >= ZEPHR_KEYBOARD_KEYS_COUNT) return false;
+  return zephr_ctx.keyboard.keycode_pressed_batch[keycode] == zephr_ctx.input_batch;
+}
 
-/* bool zephr_keyboard_keycode_has_been_released(ZephrKeycode keycode) { */
-/*   return core_bitset_is_set(zephr_ctx.keyboard.keycode_has_been_released_bitset, keycode); */
-/* } */
+bool zephr_keyboard_keycode_has_been_released(ZephrKeycode keycode) {
+  if (keycode >= ZEPHR_KEYBOARD_KEYS_COUNT) return false;
+  return zephr_ctx.keyboard.keycode_released_batch[keycode] == zephr_ctx.input_batch;
+}
+
+bool zephr_mouse_button_is_pressed(ZephrMouseButton button) {
+  return core_bitset_is_set(zephr_ctx.mouse.button_is_pressed_bitset, button);
+}
 
+bool zephr_mouse_button_has_been_pressed(ZephrMouseButton button) {
+  return zephr_ctx.mouse.button_pressed_batch[button] == zephr_ctx.input_batch;
+}
+
+bool zephr_mouse_button_has_been_released(ZephrMouseButton button) {
+  return zephr_ctx.mouse.button_released_batch[button] == zephr_ctx.input_batch;
+}
 
 /* ZephrScancode zephr_keyboard_keycode_to_scancode(ZephrKeycode keycode) { */
 /*   return zephr_ctx.keyboard.keycode_to_scancode[keycode]; */
@@ -992,3 +2065,80 @@ bool zephr_iter_events(ZephrEvent *event_out) {
 /* ZephrKeycode zephr_keyboard_scancode_to_keycode(ZephrScancode scancode) { */
 /*   return zephr_ctx.keyboard.scancode_to_keycode[scancode]; */
 /* } */
+
+// reads the frame as tightly packed rgb rows from top to bottom
+void zephr_read_frame(u8 *rgb_out) {
+  zephr_flush_draws();
+
+  Size size = zephr_ctx.window.size;
+  uptr row_size = (uptr)size.width * 3;
+
+  bool is_multisampled = zephr_ctx.backend == ZEPHR_BACKEND_HEADLESS && headless_msaa_fbo;
+  if (is_multisampled) {
+    // multisampled pixels can't be read directly, they're resolved first.
+    // the whole frame is, the blit would otherwise be clipped to the damage
+    GLboolean is_scissored = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, headless_msaa_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, headless_fbo);
+    glBlitFramebuffer(0, 0, size.width, size.height, 0, 0, size.width, size.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, headless_fbo);
+    if (is_scissored) glEnable(GL_SCISSOR_TEST);
+  }
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, size.width, size.height, GL_RGB, GL_UNSIGNED_BYTE, rgb_out);
+
+  if (is_multisampled) {
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_msaa_fbo);
+  }
+
+  // gl reads bottom to top
+  u8 *row = malloc(row_size);
+  for (int y = 0; y < size.height / 2; y++) {
+    u8 *top = rgb_out + y * row_size;
+    u8 *bottom = rgb_out + (size.height - 1 - y) * row_size;
+    memcpy(row, top, row_size);
+    memcpy(top, bottom, row_size);
+    memcpy(bottom, row, row_size);
+  }
+  free(row);
+}
+
+// saves the frame as a png or a ppm depending on the extension of the path
+bool zephr_save_frame(const char *path) {
+  Size size = zephr_ctx.window.size;
+  u8 *rgb = malloc((uptr)size.width * size.height * 3);
+  if (!rgb) return false;
+
+  zephr_read_frame(rgb);
+
+  const char *ext = strrchr(path, '.');
+  bool ok;
+  if (ext && strcmp(ext, ".ppm") == 0) {
+    ok = write_ppm(path, rgb, size.width, size.height);
+  } else {
+    ok = write_png(path, rgb, size.width, size.height);
+  }
+
+  free(rgb);
+
+  if (!ok) {
+    printf("[ERROR] Failed to save frame to \"%s\"\n", path);
+  }
+
+  return ok;
+}
+
+u64 zephr_frame_checksum(void) {
+  Size size = zephr_ctx.window.size;
+  uptr rgb_size = (uptr)size.width * size.height * 3;
+  u8 *rgb = malloc(rgb_size);
+  if (!rgb) return 0;
+
+  zephr_read_frame(rgb);
+  u64 checksum = core_hash_fnv1a_64(rgb, rgb_size, CORE_FNV1A_64_SEED);
+  free(rgb);
+
+  return checksum;
+}
@@ -1,13 +1,126 @@
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 #include <X11/XKBlib.h>
 
+#include "core.h"
+#include "renderer.h"
+#include "stream_buffer.h"
 #include "text.h"
 #include "zephr_math.h"
 
+typedef enum ZephrBackend {
+  // a window on the x11 display rendered to with glx
+  ZEPHR_BACKEND_X11,
+  // no window or display server. an egl context renders into an offscreen
+  // framebuffer that can be read back with zephr_save_frame()
+  ZEPHR_BACKEND_HEADLESS,
+} ZephrBackend;
+
+typedef enum ZephrPresentMode {
+  // swaps wait for the vertical blank, so frames never tear
+  ZEPHR_PRESENT_MODE_VSYNC,
+  // like vsync, but a frame that misses the vertical blank is swapped right
+  // away and tears instead of waiting a whole refresh (GLX_EXT_swap_control_tear)
+  ZEPHR_PRESENT_MODE_ADAPTIVE_VSYNC,
+  // swaps as soon as the frame is done
+  ZEPHR_PRESENT_MODE_UNCAPPED,
+  // no vsync, frames are spaced out to the frame cap by sleeping
+  ZEPHR_PRESENT_MODE_CAPPED,
+  ZEPHR_PRESENT_MODES_COUNT,
+} ZephrPresentMode;
+
+typedef enum ZephrAntiAliasing {
+  // hard edges, the cheapest
+  ZEPHR_ANTI_ALIASING_NONE,
+  // the shapes smooth their edges from their distance fields, at no cost in
+  // framebuffer size or bandwidth
+  ZEPHR_ANTI_ALIASING_ANALYTIC,
+  // a multisampled framebuffer on top of the analytic edges, which only adds
+  // anything for the edges of rotated quads
+  ZEPHR_ANTI_ALIASING_MSAA_2,
+  ZEPHR_ANTI_ALIASING_MSAA_4,
+  ZEPHR_ANTI_ALIASING_MSAA_8,
+  ZEPHR_ANTI_ALIASING_MODES_COUNT,
+} ZephrAntiAliasing;
+
+typedef struct ZephrFramePacing {
+  ZephrPresentMode mode;
+  double frame_cap_hz;
+  // from GLX_OML_sync_control when available, otherwise assumed to be 60hz
+  double refresh_hz;
+  // delays the start of the frame, and with it the input sampling, until just
+  // enough time is left to render it before the next present
+  bool render_late;
+  // how long a frame takes from its start until it is ready to be swapped.
+  // rises right away and decays slowly so that render late rarely misses
+  double render_ms;
+  double frame_start_ms;
+  // when the next frame is expected to be presented
+  double next_present_ms;
+} ZephrFramePacing;
+
+// latencies are bucketed by this many ms, the last bucket also collects
+// everything past it
+#define ZEPHR_LATENCY_BUCKET_MS 0.5
+#define ZEPHR_LATENCY_BUCKETS_COUNT 400
+// the most swapped frames with input that can wait on their present time
+#define ZEPHR_LATENCY_PENDING_COUNT 8
+
+typedef struct ZephrLatencyHistogram {
+  u32 buckets[ZEPHR_LATENCY_BUCKETS_COUNT];
+  u32 samples_count;
+  double total_ms;
+  double max_ms;
+} ZephrLatencyHistogram;
+
+typedef enum ZephrPresentTiming {
+  // the present time isn't known, only when the swap returned
+  ZEPHR_PRESENT_TIMING_NONE,
+  // GLX_INTEL_swap_event reports when every swap completed
+  ZEPHR_PRESENT_TIMING_INTEL_SWAP_EVENT,
+  // GLX_OML_sync_control is polled every frame for the swaps that completed
+  // and the time of the vertical blank they completed by
+  ZEPHR_PRESENT_TIMING_OML_SYNC_CONTROL,
+  // headless frames are done when the swap returns
+  ZEPHR_PRESENT_TIMING_FINISH,
+} ZephrPresentTiming;
+
+typedef struct ZephrPendingPresent {
+  // the swap buffer count the frame is presented at
+  i64 sbc;
+  double input_ms;
+} ZephrPendingPresent;
+
+typedef struct ZephrPresentEvent {
+  i64 sbc;
+  double present_ms;
+} ZephrPresentEvent;
+
+// tracks the time from input events being received until the frames that
+// reflect them are swapped and presented
+typedef struct ZephrLatency {
+  ZephrPresentTiming present_timing;
+  // receive time of the earliest input the frame being drawn reflects, -1 if none
+  double frame_input_ms;
+  // swaps issued so far plus the swap buffer count of the drawable before
+  // the first one, so that it lines up with the sbc reported by glx
+  i64 sbc;
+  ZephrPendingPresent pending[ZEPHR_LATENCY_PENDING_COUNT];
+  int pending_count;
+  // swap complete events are read with the other events, which may happen on
+  // another thread than the swaps. they're handed over through this ring with
+  // a power of two number of slots
+  ZephrPresentEvent present_events[ZEPHR_LATENCY_PENDING_COUNT];
+  atomic_uint present_events_head;
+  atomic_uint present_events_tail;
+  ZephrLatencyHistogram input_to_swap;
+  ZephrLatencyHistogram input_to_present;
+} ZephrLatency;
+
 typedef struct ZephrWindow {
   Size size;
   bool is_fullscreen;
@@ -21,6 +134,11 @@ typedef enum ZephrEventType {
   ZEPHR_EVENT_MOUSE_BUTTON_RELEASED,
   ZEPHR_EVENT_MOUSE_SCROLL,
   ZEPHR_EVENT_WINDOW_RESIZED,
+  // some of the window needs drawing again, e.g. after it was uncovered
+  ZEPHR_EVENT_WINDOW_EXPOSED,
+  // the keys and buttons held down are released when this is handed out, as
+  // their releases go to whichever window has the focus now
+  ZEPHR_EVENT_WINDOW_FOCUS_LOST,
   ZEPHR_EVENT_WINDOW_CLOSED
 } ZephrEventType;
 
@@ -40,6 +158,7 @@ typedef enum ZephrMouseButton {
   ZEPHR_MOUSE_BUTTON_5,
   ZEPHR_MOUSE_BUTTON_6,
   ZEPHR_MOUSE_BUTTON_7,
+  ZEPHR_MOUSE_BUTTON_COUNT,
 } ZephrMouseButton;
 
 
@@ -303,19 +422,38 @@ typedef enum ZephrKeyMod {
 	ZEPHR_KEY_MOD_NUM_LOCK =    0x2000,
 } ZephrKeyMod;
 
+// the keycodes that are tracked, all of the ones that have a key are below it
+#define ZEPHR_KEYBOARD_KEYS_COUNT 256
+
+// what is held down and what changed in the events handed out by the last
+// zephr_poll_events(). instead of sets that are cleared for every batch, a
+// change is stamped with the batch it happened in and only counts while that
+// batch is the current one
 typedef struct ZephrKeyboard {
   ZephrKeycode scancode_to_keycode[ZEPHR_KEYCODE_COUNT];
   ZephrScancode keycode_to_scancode[ZEPHR_KEYCODE_COUNT];
   /* u64 scancode_is_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
   /* u64 scancode_has_been_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
   /* u64 scancode_has_been_released_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
-  /* u64 keycode_is_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
-  /* u64 keycode_has_been_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
-  /* u64 keycode_has_been_released_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYCODE_COUNT, 64)]; */
+  u64 keycode_is_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_KEYBOARD_KEYS_COUNT, 64)];
+  u64 keycode_pressed_batch[ZEPHR_KEYBOARD_KEYS_COUNT];
+  u64 keycode_released_batch[ZEPHR_KEYBOARD_KEYS_COUNT];
 } ZephrKeyboard;
 
+// same as ZephrKeyboard for the mouse buttons
+typedef struct ZephrMouse {
+  u64 button_is_pressed_bitset[CORE_DIV_ROUND_UP(ZEPHR_MOUSE_BUTTON_COUNT, 64)];
+  u64 button_pressed_batch[ZEPHR_MOUSE_BUTTON_COUNT];
+  u64 button_released_batch[ZEPHR_MOUSE_BUTTON_COUNT];
+} ZephrMouse;
+
 typedef struct ZephrEvent {
   ZephrEventType type;
+  // the x server's timestamp of input events in ms, 0 for other events. it's
+  // on the server's clock which can't be compared with received_ms
+  u32 server_time;
+  // when the event was read from the display connection, on the zephr_now_ms() clock
+  double received_ms;
 
   union {
     struct {
@@ -338,36 +476,124 @@ typedef struct ZephrEvent {
     } window;
   };
 } ZephrEvent;
-/* CORE_DEFINE_STACK(ZephrEvent); */
+
+// how many events are kept between two calls to zephr_poll_events(), the
+// rest stay queued on the display connection until the next one
+#define ZEPHR_EVENT_QUEUE_CAPACITY 256
+
+// a ring of the translated events that haven't been handed to the app yet
+typedef struct ZephrEventQueue {
+  ZephrEvent events[ZEPHR_EVENT_QUEUE_CAPACITY];
+  u32 head;
+  u32 count;
+} ZephrEventQueue;
 
 typedef struct Context {
+  ZephrBackend backend;
+  // the anti-aliasing in use, which can be less than requested
+  ZephrAntiAliasing anti_aliasing;
   Atom window_delete_atom;
   bool should_quit;
   Size screen_size;
   ZephrWindow window;
   ZephrFont font;
-  /* ZephrKeyboard keyboard; */
+  ZephrFramePacing pacing;
+  ZephrLatency latency;
+  ZephrKeyboard keyboard;
+  ZephrMouse mouse;
+  // counts the batches of events handed out. it starts at 1 in init_zephr()
+  // so the zeroed stamps never match, and is 64 bits so it never wraps back
+  // around to an old stamp
+  u64 input_batch;
   /* XkbDescPtr xkb; */
   /* XIM xim; */
-  /* CoreStack(ZephrEvent) event_queue; */
-  /* u32 event_queue_cursor; */
+  ZephrEventQueue event_queue;
+  // the events handed out by the last zephr_poll_events(), in order
+  ZephrEvent frame_events[ZEPHR_EVENT_QUEUE_CAPACITY];
 
   Matrix4x4 projection;
+  // transient render data. reset every frame in zephr_swap_buffers()
+  CoreArena frame_arena;
+  // glyph and shape instances are streamed through this every frame
+  StreamBuffer instance_stream;
+  // the draws of the frame, flushed in zephr_swap_buffers() at the latest
+  Renderer renderer;
 } Context;
 
-u32 init_zephr(const char* font_path, const char* window_title, Size window_size);
+// the anti-aliasing falls back to fewer samples when the framebuffer for the
+// requested one isn't available, down to analytic
+u32 init_zephr(const char* font_path, FontRenderMode font_render_mode, const char* window_title, Size window_size, ZephrBackend backend, ZephrAntiAliasing anti_aliasing);
 void deinit_zephr(void);
+// begins the frame and updates the app. for when the same thread draws and
+// handles the events, otherwise see zephr_begin_frame() and zephr_update()
 bool zephr_should_quit(void);
+// paces the frame and starts it, only what changed since the back buffer was
+// last drawn gets cleared and drawn. MUST be called on the thread that owns
+// the context
+void zephr_begin_frame(void);
+// how many frames ago the back buffer was drawn, 0 when its contents are unknown
+int zephr_buffer_age(void);
+// updates the audio and returns whether the app should quit, for a thread that
+// handles the events but doesn't draw
+bool zephr_update(void);
+// makes the context current on the calling thread or releases it, so that
+// another thread than the one that called init_zephr() can draw
+void zephr_make_context_current(bool current);
+// applies the size to the viewport and projection. MUST be called on the
+// thread that owns the context after the window was resized
+void zephr_resize(Size size);
 void zephr_swap_buffers(void);
+// draws everything that was recorded so far in the frame
+void zephr_flush_draws(void);
+// returns the mode that was actually set, which falls back to vsync when
+// adaptive vsync isn't supported and to uncapped for vsync modes in headless
+ZephrPresentMode zephr_set_present_mode(ZephrPresentMode mode, double frame_cap_hz);
+void zephr_set_render_late(bool render_late);
+double zephr_now_ms(void);
+// tags the frame being drawn as reflecting the event, so that the latency
+// from the event until the frame is swapped and presented is recorded
+void zephr_frame_reflects_event(const ZephrEvent *event);
+void zephr_print_latency_report(void);
+// writes the latency histograms as csv
+bool zephr_export_latency(const char *path);
+const char *zephr_present_mode_name(ZephrPresentMode mode);
+const char *zephr_anti_aliasing_name(ZephrAntiAliasing anti_aliasing);
+// the number of samples per pixel of the framebuffer, 0 when it isn't multisampled
+int zephr_anti_aliasing_samples(ZephrAntiAliasing anti_aliasing);
+// the time between presents that the present mode aims for
+double zephr_frame_budget_ms(void);
 Size zephr_get_window_size(void);
 void zephr_make_window_non_resizable(void);
 void zephr_toggle_fullscreen(void);
 void zephr_quit(void);
-bool zephr_iter_events(ZephrEvent *event_out);
-
-/* bool zephr_keyboard_keycode_is_pressed(ZephrKeycode keycode); */
-/* bool zephr_keyboard_keycode_has_been_pressed(ZephrKeycode keycode); */
-/* bool zephr_keyboard_keycode_has_been_released(ZephrKeycode keycode); */
+// reads all the events pending on the display connection at once and returns
+// them in order with the redundant ones merged: a burst of resizes is one
+// resize and an auto-repeated key is a single press with is_repeat set. the
+// array is valid until the next call
+u32 zephr_poll_events(const ZephrEvent **events_out);
+// queues an event as if it had come from the window, e.g. to replay input
+void zephr_push_event(const ZephrEvent *event);
+// blocks until there are events to poll, zephr_wake() is called or the
+// timeout passes. a negative timeout waits for as long as it takes
+void zephr_wait_events(double timeout_ms);
+// makes zephr_wait_events() return, e.g. when a worker thread finished
+// something. can be called from any thread
+void zephr_wake(void);
+// these read the frame that is being drawn, so call them before zephr_swap_buffers()
+void zephr_read_frame(u8 *rgb_out);
+bool zephr_save_frame(const char *path);
+u64 zephr_frame_checksum(void);
+
+// whether the key is held down after the events handed out by the last
+// zephr_poll_events()
+bool zephr_keyboard_keycode_is_pressed(ZephrKeycode keycode);
+// whether the key went down or up in the events handed out by the last
+// zephr_poll_events(). auto-repeats don't count, a tap counts as both
+bool zephr_keyboard_keycode_has_been_pressed(ZephrKeycode keycode);
+bool zephr_keyboard_keycode_has_been_released(ZephrKeycode keycode);
+bool zephr_mouse_button_is_pressed(ZephrMouseButton button);
+bool zephr_mouse_button_has_been_pressed(ZephrMouseButton button);
+bool zephr_mouse_button_has_been_released(ZephrMouseButton button);
 
 /* ZephrScancode zephr_keyboard_keycode_to_scancode(ZephrKeycode keycode); */
 /* ZephrKeycode zephr_keyboard_scancode_to_keycode(ZephrScancode scancode); */
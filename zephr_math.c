@@ -30,47 +30,34 @@ Matrix4x4 identity(void) {
     return result;
 }
 
-void mult_4x4(Matrix4x4 *multiplicant, Matrix4x4 *multiplier) {
-  Matrix4x4 result = identity();
-
-  for (int i = 0; i < 4; i++) {
-    for (int j = 0; j < 4; j++) {
-      result.m[i][j] = 0;
-      for (int k = 0; k < 4; k++) {
-        result.m[i][j] += multiplicant->m[i][k] * multiplier->m[k][j];
-      }
-    }
+Affine2D affine_scale_rotate_translate(Sizef scale, float angle, Vec2f pivot, Vec2f translation) {
+  float c = 1.f;
+  float s = 0.f;
+  if (angle != 0.f) {
+    c = cosf(angle);
+    s = sinf(angle);
   }
 
-  *multiplicant = result;
-}
-
-void apply_scale(Matrix4x4 *matrix, Sizef scale) {
-  Matrix4x4 temp = identity();
-
-  temp.m[0][0] = scale.width;
-  temp.m[1][1] = scale.height;
+  // x' = x * c - y * s, y' = x * s + y * c
+  Affine2D result = {
+    .m = { scale.width * c, scale.width * s, -scale.height * s, scale.height * c },
+  };
+  // rotating around the pivot moves it by p - R(p)
+  result.t[0] = pivot.x - (pivot.x * c - pivot.y * s) + translation.x;
+  result.t[1] = pivot.y - (pivot.x * s + pivot.y * c) + translation.y;
 
-  mult_4x4(matrix, &temp);
+  return result;
 }
 
-void apply_rotation(Matrix4x4 *model, float angle) {
-  Matrix4x4 temp = identity();
-
-  temp.m[0][0] = (float)cos(angle);
-  temp.m[0][1] = (float)sin(angle);
-  temp.m[1][0] = -(float)sin(angle);
-  temp.m[1][1] = (float)cos(angle);
-
-  mult_4x4(model, &temp);
-}
-
-void apply_translation(Matrix4x4 *matrix, Vec2f pos) {
-  Matrix4x4 temp = identity();
+Matrix4x4 affine_to_matrix4x4(const Affine2D *transform) {
+  Matrix4x4 result = identity();
 
-  temp.m[3][0] = pos.x;
-  temp.m[3][1] = pos.y;
+  result.m[0][0] = transform->m[0];
+  result.m[0][1] = transform->m[1];
+  result.m[1][0] = transform->m[2];
+  result.m[1][1] = transform->m[3];
+  result.m[3][0] = transform->t[0];
+  result.m[3][1] = transform->t[1];
 
-  mult_4x4(matrix, &temp);
+  return result;
 }
-
@@ -38,10 +38,21 @@ typedef struct Color {
   float a;
 } Color;
 
+// a 2d affine transform, for row vectors like Matrix4x4:
+// x' = x * m[0] + y * m[2] + t[0]
+// y' = x * m[1] + y * m[3] + t[1]
+// the linear part fills a 16 byte aligned vector so it can be loaded as one
+// sse/neon register. it's only turned into a Matrix4x4 when it's uploaded
+typedef struct Affine2D {
+  _Alignas(16) float m[4];
+  float t[2];
+  float _pad[2];
+} Affine2D;
+
 float to_radians(float degrees);
 Matrix4x4 identity(void);
-void mult_4x4(Matrix4x4 *multiplicant, Matrix4x4 *multiplier);
-void apply_scale(Matrix4x4 *matrix, Sizef scale);
-void apply_rotation(Matrix4x4 *model, float angle);
-void apply_translation(Matrix4x4 *matrix, Vec2f pos);
 Matrix4x4 orthographic_projection_2d(float left, float right, float bottom, float top);
+// scales, then rotates by the angle in radians around the pivot (which is in
+// scaled space) and then translates. skips the trigonometry when not rotated
+Affine2D affine_scale_rotate_translate(Sizef scale, float angle, Vec2f pivot, Vec2f translation);
+Matrix4x4 affine_to_matrix4x4(const Affine2D *transform);